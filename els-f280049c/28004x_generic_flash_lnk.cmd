@@ -120,5 +120,21 @@ SECTIONS
                          RUN_END(_RamfuncsRunEnd),
                          PAGE = 0, ALIGN(4)
 
+   /* Stepper interrupt and the motion code inlined into it; see MOTION_CODE_IN_RAM.
+      RAMLS4 is reserved for it so it never competes with .TI.ramfunc for space,
+      and the objects it touches are in .ebss, which is also zero-wait RAM.
+      RAMLS4 is 0x800 words and the section is placed nowhere else, so if the
+      inlined ISR outgrows it the link fails instead of spilling into flash.
+      The run-time support 32- and 64-bit divide helpers, called by the fixed-point
+      feed ratios and the ramps, come along so the ISR never branches to flash. */
+   motionfuncs      : { *(motionfuncs)
+                        -l rts2800_fpu32.lib<ll_div28.asm.obj l_div28.asm.obj> (.text) }
+                         LOAD = FLASH_BANK0_SEC5,
+                         RUN = RAMLS4,
+                         LOAD_START(_MotionfuncsLoadStart),
+                         LOAD_SIZE(_MotionfuncsLoadSize),
+                         RUN_START(_MotionfuncsRunStart),
+                         PAGE = 0, ALIGN(4)
+
 }
 
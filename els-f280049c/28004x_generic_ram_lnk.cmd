@@ -96,7 +96,8 @@ SECTIONS
 {
    codestart        : > BEGIN,     PAGE = 0
    .TI.ramfunc      : > RAMM0      PAGE = 0
-   .text            : >>RAMM0 | RAMLS0 | RAMLS1 | RAMLS2 | RAMLS3 | RAMLS4,   PAGE = 0
+   motionfuncs      : > RAMLS4,    PAGE = 0
+   .text            : >>RAMM0 | RAMLS0 | RAMLS1 | RAMLS2 | RAMLS3,   PAGE = 0
    .cinit           : > RAMM0,     PAGE = 0
    .pinit           : > RAMM0,     PAGE = 0
    .switch          : > RAMM0,     PAGE = 0
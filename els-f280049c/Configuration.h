@@ -81,14 +81,47 @@
 // Enable servo alarm feedback
 #define USE_ALARM_PIN
 
+// Stepping stops while an alarm is latched, but the synchronized position keeps
+// following the spindle.  Once the alarm is cleared, the drives are brought
+// back to it at no more than RESUME_MAX_RATE steps per second, accelerating at
+// RESUME_ACCELERATION steps per second per second.
+#define RESUME_MAX_RATE 5000
+#define RESUME_ACCELERATION 50000
+
+
+
+
+//================================================================================
+//                                CROSS-SLIDE
+//
+// Optionally drive a second stepper/servo on the cross-slide, slaved to the
+// spindle at its own ratio.  This allows tapers (both axes locked to the spindle)
+// and chamfer or pull-out moves.  The cross-slide drive uses the same pin
+// polarity settings as the leadscrew drive.
+//================================================================================
+
+// Enable the cross-slide axis
+//#define USE_CROSS_SLIDE
+
+// Cross-slide steps that move the cross-slide as far as one leadscrew step
+// moves the carriage.  For example, a 10 TPI cross-slide screw with the same
+// steps per turn as a 12 TPI leadscrew is 10:12.
+#define CROSS_SLIDE_STEPS_NUMERATOR 1
+#define CROSS_SLIDE_STEPS_DENOMINATOR 1
+
+// The taper is set with the power off: press IN/MM to bring up TAP, set the
+// cross-slide travel per unit of carriage travel with UP/DOWN (0.001 to
+// 0.999; 0 holds the cross-slide), reverse it with FWD/REV and press SET to
+// keep it.  The cross-slide then follows every feed and thread at that ratio.
+
 
 
 
 //================================================================================
 //                                 ENCODER
 //
-// Define the type of encoder you are using on the spindle.  The firmware assumes
-// the encoder is turning at a 1:1 ratio with the spindle.
+// Define the type of encoder you are using on the spindle.  If the encoder is
+// not turning at a 1:1 ratio with the spindle, set the gear ratio below.
 //
 // NOTE: the firmware is concerned with the quadrature edge count, which is
 // four times the number of pulses.  For example, if you have a 1024 P/R
@@ -98,10 +131,123 @@
 // Encoder resolution (counts per revolution)
 #define ENCODER_RESOLUTION 4096
 
+// Encoder gearing: the encoder turns ENCODER_GEAR_NUMERATOR times for every
+// ENCODER_GEAR_DENOMINATOR turns of the spindle.  For example, an encoder on a
+// countershaft driven by a 60-tooth spindle pulley through a 25-tooth pulley is
+// 60:25.  Use 1:1 for an encoder mounted on the spindle.
+#define ENCODER_GEAR_NUMERATOR 1
+#define ENCODER_GEAR_DENOMINATOR 1
+
 // Which encoder input to use
 #define ENCODER_USE_EQEP1
 //#define ENCODER_USE_EQEP2
 
+// Phase errors (simultaneous A/B edges) and index pulses that don't land a
+// whole revolution from the last one are counted, and can be viewed by pressing
+// SET with the power off.  Warn the operator after this many new errors.
+#define ENCODER_ERROR_WARNING 10
+
+// Allowed difference, in counts, between ENCODER_RESOLUTION and the count
+// from one index pulse to the next
+#define ENCODER_INDEX_TOLERANCE 2
+
+// Correct the spindle position when an index pulse shows counts were missed
+// or gained, easing it in a count at a time.  Errors of more than
+// ENCODER_INDEX_ALARM_COUNTS are too big to trust and stop the machine with an
+// alarm instead.  Harmless with an encoder that has no index.
+//#define USE_INDEX_CORRECTION
+#define ENCODER_INDEX_ALARM_COUNTS 16
+
+// Speed is sampled this many times per encoder revolution, and the spread
+// between the fastest and slowest sample over each revolution can be viewed
+// with the other diagnostics, along with the spindle acceleration.  A big
+// spread at a steady speed points to a slipping belt or a poorly tuned VFD.
+#define ENCODER_SPEED_SAMPLES 16
+
+// The resolution can also be measured from the index pulse: with the power off,
+// press SET, page to RES and press FWD/REV, then run the spindle for this many
+// revolutions.  The result is saved in EEPROM and used instead of
+// ENCODER_RESOLUTION from then on.
+#define ENCODER_CALIBRATION_REVS 10
+
+// Input qualification filters glitches off the encoder lines, but too much of
+// it loses real edges at speed.  To calibrate it, with the power off press SET,
+// page to QUAL and press FWD/REV with the spindle stopped.  NOIS raises the
+// filter from none until the lines are quiet for ENCODER_QUALIFY_SECONDS; then
+// start the spindle when SPIN shows and run it at a steady speed while RUN
+// counts errors.  RUN starts from the strongest filter that passes
+// ENCODER_MAX_RPM and backs off until running is clean, but never below what
+// NOIS found.  The result is saved in EEPROM; if no level is clean both at rest
+// and running, CAL ERR shows and the old setting is kept.
+#define ENCODER_MAX_RPM 3000
+#define ENCODER_QUALIFY_SECONDS 5
+
+
+
+
+//================================================================================
+//                             LEADSCREW ENCODER
+//
+// Optionally read a second encoder on the leadscrew or carriage, using the eQEP
+// input that is not used by the spindle encoder.  The firmware compares the
+// actual position against the commanded stepper position and injects correction
+// steps when the drive misses steps.
+//
+// LEADSCREW_ENCODER_RESOLUTION is the quadrature count for the movement produced
+// by LEADSCREW_ENCODER_STEPS steps of the drive.  For an encoder on the leadscrew
+// itself, that's one turn of the leadscrew.
+//================================================================================
+
+// Enable closed-loop correction from a leadscrew encoder
+//#define USE_LEADSCREW_ENCODER
+
+// Encoder counts for LEADSCREW_ENCODER_STEPS stepper steps
+#define LEADSCREW_ENCODER_RESOLUTION 4000
+#define LEADSCREW_ENCODER_STEPS (STEPPER_RESOLUTION * STEPPER_MICROSTEPS)
+
+// Define if the encoder counts down when the stepper moves forward
+//#define LEADSCREW_ENCODER_REVERSE
+
+// Following error, in steps, tolerated before correction steps are injected
+#define LEADSCREW_ENCODER_DEADBAND_STEPS 2
+
+// Following error, in steps, that means sync has been lost
+#define LEADSCREW_ENCODER_FAULT_STEPS 400
+
+
+
+
+//================================================================================
+//                                 HANDWHEEL
+//
+// Optionally read a manual pulse generator (MPG) handwheel on the eQEP input
+// that is not used by the spindle encoder, and jog the leadscrew with it.  The
+// handwheel works whenever the spindle is stopped, or at any time once jog mode
+// is latched.  Turning it brings up the JOG display, where UP/DOWN select the
+// x1/x10/x100 scale and SET latches jog mode on and off.
+//
+// The handwheel and the leadscrew encoder share the same eQEP, so only one of
+// them can be used.
+//================================================================================
+
+// Enable the handwheel
+//#define USE_HANDWHEEL
+
+// Quadrature counts per detent; 4 for the usual 100 P/R MPG
+#define HANDWHEEL_COUNTS_PER_DETENT 4
+
+// Leadscrew steps per detent at x1
+#define HANDWHEEL_STEPS_PER_DETENT 1
+
+// Top speed, in leadscrew steps per second, and acceleration, in steps per
+// second per second, of a jog.  Detents turned faster than the carriage can
+// follow are queued up and stepped out at this rate.
+#define HANDWHEEL_MAX_RATE 10000
+#define HANDWHEEL_ACCELERATION 50000
+
+// Define if the carriage moves the wrong way
+//#define HANDWHEEL_REVERSE
+
 
 
 
@@ -160,8 +306,46 @@
 // User interface refresh rate, in Hertz
 #define UI_REFRESH_RATE_HZ 100
 
-// RPM recalculation rate, in Hz
-#define RPM_CALC_RATE_HZ 2
+// Control panel key scan rate, in Hertz.  Debounce, repeat and long-press
+// timing is measured in time, so this only sets how soon a change is seen.
+#define KEY_SCAN_RATE_HZ 200
+
+// RPM recalculation rate, in Hz.  At low speed the RPM comes from the time
+// between encoder counts, so it stays precise even with a short window.
+#define RPM_CALC_RATE_HZ UI_REFRESH_RATE_HZ
+
+// Settings save rate, in Hertz.  Each run also checks on a write already in
+// progress, so this sets how soon a change reaches the EEPROM.
+#define SETTINGS_SAVE_RATE_HZ 1
+
+// Rate the main loop counters are copied for the diagnostics pages, in Hertz
+#define TELEMETRY_RATE_HZ 10
+
+// When the power is off, or the spindle and drives have been still for
+// IDLE_DELAY_MS, the stepper interrupt slows to one poll every IDLE_CYCLE_US
+// and returns to full speed as soon as anything moves.  With the power on, the
+// first spindle encoder edge wakes it through XINT1/XINT2 without waiting for
+// the poll; the WLAT and WMAX diagnostic pages show how long that took.
+#define IDLE_CYCLE_US 1000
+#define IDLE_DELAY_MS 100
+
+// Run the stepper interrupt, with the Core and StepperDrive code inlined into
+// it, from zero-wait RAM rather than flash.  Comment this out to run it from
+// flash, e.g. to compare the ISR cycle counts on the ISR and ISRM diagnostics
+// pages.  The code must fit RAMLS4 (0x800 words) or the link fails.
+//
+// To compare: build Release with this defined, flash it, run the spindle at a
+// steady speed with a thread selected and note ISR and ISRM (FWD/REV on the
+// ISRM page resets it).  Then comment it out and also delete the
+// rts2800_fpu32.lib line from motionfuncs in 28004x_generic_flash_lnk.cmd, so
+// the divide helpers go back to flash too, and repeat at the same speed and
+// feed.  The Jenkins "Section Layout" stage shows where everything landed.
+#define MOTION_CODE_IN_RAM
+
+// Timestamp every leadscrew STEP rising edge against the stepper timer tick and
+// keep min/max/mean latency statistics in Debug, bucketed by RPM and feed.
+// Adds a few cycles per step; leave off for normal use.
+//#define MEASURE_STEP_JITTER
 
 // Microprocessor system clock
 #define CPU_CLOCK_MHZ 100
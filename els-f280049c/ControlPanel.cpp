@@ -32,16 +32,49 @@
 // Time delay after sending read command, before clocking in data
 #define DELAY_BEFORE_READING_US 3
 
-// Number of times a key state must be read consecutively to be considered stable
-#define MIN_CONSECUTIVE_READS 3
+// Time a key state must be read unchanged to be considered stable
+#define KEY_DEBOUNCE_MS 10
 
+// Keys that auto-repeat while held
+#define KEY_REPEAT_MASK ((1 << 0) | (1 << 2)) // UP, DOWN
 
-// Lower the TM1638 CS (STB) line
-#define CS_ASSERT GpioDataRegs.GPBCLEAR.bit.GPIO33 = 1
+// Auto-repeat starts after KEY_REPEAT_DELAY_MS, then each repeat comes 3/4 as
+// long after the last, down to KEY_REPEAT_FASTEST_MS
+#define KEY_REPEAT_DELAY_MS 500
+#define KEY_REPEAT_SLOWEST_MS 250
+#define KEY_REPEAT_FASTEST_MS 40
+
+// Holding a key this long also gives a long-press event
+#define KEY_LONG_PRESS_MS 1000
+
+// Key timing runs off CPU timer 2, which the scheduler runs free at SYSCLK;
+// it counts down, so elapsed time is the start count less the current one
+#define MS_TO_CYCLES(ms) ((Uint32)(ms) * CPU_CLOCK_MHZ * 1000)
+#define TIMER_NOW CpuTimer2Regs.TIM.all
+#define ELAPSED(since) ((since) - TIMER_NOW)
+
+// Refreshes between full resends, in case the TM1638 missed something
+#define DISPLAY_RESYNC_REFRESHES 100
+
+
+// TM1638 CS (STB) line, GPIO33
+#define CS_MASK ((Uint32)1 << (33 - 32))
 
 // Raise the TM1638 CS (STB) line
 #define CS_RELEASE GpioDataRegs.GPBSET.bit.GPIO33 = 1
 
+// SPI bit rate = LSPCLK/128 ~ 98Kbps
+#define PANEL_BIT_RATE 127
+
+// The TM1638: 8-bit words in 3-wire mode, and it can wait for the EEPROM
+static const SPI_DEVICE panelDevice = { CS_MASK, SPI_THREE_WIRE, PANEL_BIT_RATE, SPI_PRIORITY_LOW };
+
+// Display update: brightness and data commands, then an address and a byte
+// for each changed grid; in GSRAM so the DMA can stream it to the bus
+#define DISPLAY_FRAME_LENGTH (2 + 2*DISPLAY_GRID_SIZE)
+#pragma DATA_SECTION("ramgs0")
+static Uint16 displayFrame[DISPLAY_FRAME_LENGTH];
+
 
 ControlPanel :: ControlPanel(SPIBus *spiBus)
 {
@@ -51,9 +84,49 @@ ControlPanel :: ControlPanel(SPIBus *spiBus)
     this->leds.all = 0;
     this->keys.all = 0;
     this->stableKeys.all = 0;
-    this->stableCount = 0;
+    this->stableTime = 0;
+    this->settled = false;
     this->message = NULL;
     this->brightness = 3;
+
+    // display steps are filled in as the display changes
+    this->displayTransaction.device = &panelDevice;
+    this->displayTransaction.steps = this->displaySteps;
+    this->displayTransaction.stepCount = 0;
+    this->displayTransaction.busy = false;
+    this->sentBrightness = 0;
+    this->sentValid = false;
+    this->resyncCount = 0;
+
+    // auto-increment, then the read command and the four key bytes in one frame
+    this->keyCommands[0] = reverse_byte(0x40);
+    this->keyCommands[1] = reverse_byte(0x42);
+    this->keySteps[0].flags = SPI_SEND | SPI_RELEASE;
+    this->keySteps[0].count = 1;
+    this->keySteps[0].data = &this->keyCommands[0];
+    this->keySteps[0].delayUs = CS_RISE_TIME_US;
+    this->keySteps[1].flags = SPI_SEND;
+    this->keySteps[1].count = 1;
+    this->keySteps[1].data = &this->keyCommands[1];
+    this->keySteps[1].delayUs = DELAY_BEFORE_READING_US; // required by TM1638 per datasheet
+    this->keySteps[2].flags = SPI_RELEASE;
+    this->keySteps[2].count = 4;
+    this->keySteps[2].data = this->keyData;
+    this->keySteps[2].delayUs = CS_RISE_TIME_US;
+
+    this->keyTransaction.device = &panelDevice;
+    this->keyTransaction.steps = this->keySteps;
+    this->keyTransaction.stepCount = 3;
+    this->keyTransaction.busy = false;
+    this->keysRead = false;
+
+    this->keyActive = false;
+    this->pressTime = 0;
+    this->repeatTime = 0;
+    this->repeatInterval = 0;
+    this->longPressed = false;
+    this->keyQueueHead = 0;
+    this->keyQueueCount = 0;
 }
 
 void ControlPanel :: initHardware(void)
@@ -68,13 +141,6 @@ void ControlPanel :: initHardware(void)
     EDIS;
 }
 
-void ControlPanel :: configureSpiBus( void )
-{
-    // configure the shared bus
-    this->spiBus->setThreeWire();
-    this->spiBus->setEightBits();
-}
-
 Uint16 ControlPanel :: reverse_byte(Uint16 x)
 {
     static const Uint16 table[] = {
@@ -114,25 +180,16 @@ Uint16 ControlPanel :: reverse_byte(Uint16 x)
     return table[x];
 }
 
-Uint16 ControlPanel :: lcd_char(Uint16 x)
+Uint16 *ControlPanel :: addDisplayStep(Uint16 *data, Uint16 count)
 {
-    static const Uint16 table[] = {
-        0b1111110000000000, // 0
-        0b0110000000000000, // 1
-        0b1101101000000000, // 2
-        0b1111001000000000, // 3
-        0b0110011000000000, // 4
-        0b1011011000000000, // 5
-        0b1011111000000000, // 6
-        0b1110000000000000, // 7
-        0b1111111000000000, // 8
-        0b1111011000000000, // 9
-        0b0000000100000000  // .
-    };
-    if( x < sizeof(table) ) {
-        return table[x];
-    }
-    return table[sizeof(table)-1];
+    SPI_STEP *step = &this->displaySteps[this->displayTransaction.stepCount++];
+
+    step->flags = SPI_SEND | SPI_DMA | SPI_RELEASE;
+    step->count = count;
+    step->data = data;
+    step->delayUs = CS_RISE_TIME_US;
+
+    return data + count;
 }
 
 void ControlPanel :: sendData()
@@ -140,51 +197,90 @@ void ControlPanel :: sendData()
     int i;
     Uint16 ledMask = this->leds.all;
     Uint16 briteVal = 0x80;
+    Uint16 grid[DISPLAY_GRID_SIZE];
+    Uint16 changed = 0;
     if( this->brightness > 0 ) {
         briteVal = 0x87 + this->brightness;
     }
 
-    SpibRegs.SPICTL.bit.TALK = 1;
-
-    CS_ASSERT;
-    spiBus->sendWord(reverse_byte(briteVal));       // brightness
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);              // give CS line time to register high
+    // the bus is still sending the last update; try again next time
+    if( this->displayTransaction.busy ) {
+        return;
+    }
 
-    CS_ASSERT;
-    spiBus->sendWord(reverse_byte(0x40));           // auto-increment
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);              // give CS line time to register high
+    // every so often send everything again
+    if( ++this->resyncCount >= DISPLAY_RESYNC_REFRESHES ) {
+        this->resyncCount = 0;
+        this->sentValid = false;
+    }
 
-    CS_ASSERT;
-    spiBus->sendWord(reverse_byte(0xc0));           // display data
+    // digit and LED bytes, in TM1638 address order
     for( i=0; i < 8; i++ ) {
         if( this->message != NULL )
         {
-            spiBus->sendWord(this->message[i]);
+            grid[2*i] = this->message[i];
         }
         else
         {
-            spiBus->sendWord(this->sevenSegmentData[i]);
+            grid[2*i] = this->sevenSegmentData[i];
         }
-        spiBus->sendWord( (ledMask & 0x80) ? 0xff00 : 0x0000 );
+        grid[2*i + 1] = (ledMask & 0x80) ? 0xff00 : 0x0000;
         ledMask <<= 1;
     }
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);              // give CS line time to register high
+    for( i=0; i < DISPLAY_GRID_SIZE; i++ ) {
+        if( ! this->sentValid || grid[i] != this->sentGrid[i] ) {
+            changed++;
+        }
+    }
+
+    Uint16 *frame = displayFrame;
+    this->displayTransaction.stepCount = 0;
+
+    if( ! this->sentValid || briteVal != this->sentBrightness ) {
+        *frame = reverse_byte(briteVal);                        // brightness
+        frame = addDisplayStep(frame, 1);
+    }
+
+    if( changed > DISPLAY_GRID_SIZE / 2 ) {
+        // cheaper to write the lot with auto-increment
+        *frame = reverse_byte(0x40);                            // auto-increment
+        frame = addDisplayStep(frame, 1);
+        frame[0] = reverse_byte(0xc0);                          // display data
+        for( i=0; i < DISPLAY_GRID_SIZE; i++ ) {
+            frame[1 + i] = grid[i];
+        }
+        frame = addDisplayStep(frame, 1 + DISPLAY_GRID_SIZE);
+    }
+    else if( changed > 0 ) {
+        // write just the changed addresses
+        *frame = reverse_byte(0x44);                            // fixed address
+        frame = addDisplayStep(frame, 1);
+        for( i=0; i < DISPLAY_GRID_SIZE; i++ ) {
+            if( grid[i] != this->sentGrid[i] ) {
+                frame[0] = reverse_byte(0xc0 | i);              // address
+                frame[1] = grid[i];
+                frame = addDisplayStep(frame, 2);
+            }
+        }
+    }
 
-    SpibRegs.SPICTL.bit.TALK = 0;
+    // nothing differs
+    if( this->displayTransaction.stepCount == 0 ) {
+        return;
+    }
+
+    if( spiBus->submit(&this->displayTransaction) ) {
+        this->sentBrightness = briteVal;
+        for( i=0; i < DISPLAY_GRID_SIZE; i++ ) {
+            this->sentGrid[i] = grid[i];
+        }
+        this->sentValid = true;
+    }
 }
 
 void ControlPanel :: decomposeRPM()
 {
-    Uint16 rpm = this->rpm;
-    int i;
-
-    for(i=3; i>=0; i--) {
-        this->sevenSegmentData[i] = (rpm == 0 && i != 3) ? 0 : lcd_char(rpm % 10);
-        rpm = rpm / 10;
-    }
+    renderNumber(this->sevenSegmentData, 4, this->rpm, 0);
 }
 
 void ControlPanel :: decomposeValue()
@@ -199,57 +295,102 @@ void ControlPanel :: decomposeValue()
     }
 }
 
-KEY_REG ControlPanel :: readKeys(void)
+bool ControlPanel :: readKeys(KEY_REG *keys)
 {
-    SpibRegs.SPICTL.bit.TALK = 1;
-
-    CS_ASSERT;
-    spiBus->sendWord(reverse_byte(0x40));           // auto-increment
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);              // give CS line time to register high
+    // the last scan is still on the bus
+    if( this->keyTransaction.busy ) {
+        return false;
+    }
 
-    CS_ASSERT;
-    spiBus->sendWord(reverse_byte(0x42));
+    // pick up the last scan, if there was one, and start the next
+    bool haveKeys = this->keysRead;
+    keys->all =
+            (this->keyData[0] & 0x88) |
+            (this->keyData[1] & 0x88) >> 1 |
+            (this->keyData[2] & 0x88) >> 2 |
+            (this->keyData[3] & 0x88) >> 3;
+    this->keysRead = spiBus->submit(&this->keyTransaction);
 
-    SpibRegs.SPICTL.bit.TALK = 0;
+    return haveKeys;
+}
 
-    DELAY_US(DELAY_BEFORE_READING_US); // delay required by TM1638 per datasheet
+void ControlPanel :: queueKeyEvent(KEY_REG key, Uint16 type)
+{
+    // if the user interface has fallen this far behind, drop the new event
+    if( this->keyQueueCount >= KEY_QUEUE_LENGTH ) {
+        return;
+    }
 
-    Uint16 byte1 = spiBus->receiveWord();
-    Uint16 byte2 = spiBus->receiveWord();
-    Uint16 byte3 = spiBus->receiveWord();
-    Uint16 byte4 = spiBus->receiveWord();
+    KEY_EVENT *event = &this->keyQueue[(this->keyQueueHead + this->keyQueueCount) % KEY_QUEUE_LENGTH];
+    event->key = key;
+    event->type = type;
+    this->keyQueueCount++;
+}
 
-    KEY_REG keyMask;
-    keyMask.all =
-            (byte1 & 0x88) |
-            (byte2 & 0x88) >> 1 |
-            (byte3 & 0x88) >> 2 |
-            (byte4 & 0x88) >> 3;
+bool ControlPanel :: getKeyEvent(KEY_EVENT *event)
+{
+    if( this->keyQueueCount == 0 ) {
+        return false;
+    }
 
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);              // give CS line time to register high
+    *event = this->keyQueue[this->keyQueueHead];
+    this->keyQueueHead = (this->keyQueueHead + 1) % KEY_QUEUE_LENGTH;
+    this->keyQueueCount--;
 
-    return keyMask;
+    return true;
 }
 
-KEY_REG ControlPanel :: getKeys()
+void ControlPanel :: scanKeys()
 {
     KEY_REG newKeys;
-    static KEY_REG noKeys;
 
-    configureSpiBus();
+    if( ! readKeys(&newKeys) ) {
+        return;
+    }
 
-    newKeys = readKeys();
     if( isValidKeyState(newKeys) && isStable(newKeys) && newKeys.all != this->keys.all ) {
         KEY_REG previousKeys = this->keys; // remember the previous stable value
         this->keys = newKeys;
 
-        if( previousKeys.all == 0 ) {     // only act if the previous stable value was no keys pressed
-            return newKeys;
+        // only act if the previous stable value was no keys pressed
+        this->keyActive = previousKeys.all == 0 && newKeys.all != 0;
+        this->pressTime = TIMER_NOW;
+        this->repeatTime = this->pressTime;
+        this->repeatInterval = MS_TO_CYCLES(KEY_REPEAT_DELAY_MS);
+        this->longPressed = false;
+
+        if( this->keyActive ) {
+            queueKeyEvent(newKeys, KEY_PRESS);
+        }
+        return;
+    }
+
+    if( ! this->keyActive ) {
+        return;
+    }
+
+    // still held; repeats are timed from the last one, which keeps the
+    // interval short enough not to wrap the timer however long it's held
+    if( (this->keys.all & KEY_REPEAT_MASK) && ELAPSED(this->repeatTime) >= this->repeatInterval ) {
+        queueKeyEvent(this->keys, KEY_REPEAT);
+
+        // speed up the longer it's held
+        this->repeatTime -= this->repeatInterval;
+        if( this->repeatInterval > MS_TO_CYCLES(KEY_REPEAT_SLOWEST_MS) ) {
+            this->repeatInterval = MS_TO_CYCLES(KEY_REPEAT_SLOWEST_MS);
+        }
+        else {
+            this->repeatInterval = this->repeatInterval * 3 / 4;
+            if( this->repeatInterval < MS_TO_CYCLES(KEY_REPEAT_FASTEST_MS) ) {
+                this->repeatInterval = MS_TO_CYCLES(KEY_REPEAT_FASTEST_MS);
+            }
         }
     }
-    return noKeys;
+
+    if( ! this->longPressed && ELAPSED(this->pressTime) >= MS_TO_CYCLES(KEY_LONG_PRESS_MS) ) {
+        queueKeyEvent(this->keys, KEY_LONG_PRESS);
+        this->longPressed = true;
+    }
 }
 
 bool ControlPanel :: isValidKeyState(KEY_REG testKeys) {
@@ -271,21 +412,21 @@ bool ControlPanel :: isValidKeyState(KEY_REG testKeys) {
 
 
 bool ControlPanel :: isStable(KEY_REG testKeys) {
-    // don't trust any read key state until we've seen it multiple times consecutively (noise filter)
+    // don't trust any read key state until it has read the same for the
+    // debounce time (noise filter), however often the keys are scanned
     if( testKeys.all != stableKeys.all )
     {
         this->stableKeys = testKeys;
-        this->stableCount = 1;
+        this->stableTime = TIMER_NOW;
+        this->settled = false;
     }
-    else
+    else if( ! this->settled && ELAPSED(this->stableTime) >= MS_TO_CYCLES(KEY_DEBOUNCE_MS) )
     {
-        if( this->stableCount < MIN_CONSECUTIVE_READS )
-        {
-            this->stableCount++;
-        }
+        // latch it, so the timer wrapping can't unsettle a long press
+        this->settled = true;
     }
 
-    return this->stableCount >= MIN_CONSECUTIVE_READS;
+    return this->settled;
 }
 
 void ControlPanel :: setMessage( const Uint16 *message )
@@ -302,8 +443,6 @@ void ControlPanel :: setBrightness( Uint16 brightness )
 
 void ControlPanel :: refresh()
 {
-    configureSpiBus();
-
     decomposeRPM();
     decomposeValue();
 
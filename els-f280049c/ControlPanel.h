@@ -29,49 +29,9 @@
 
 #include "F28x_Project.h"
 #include "SPIBus.h"
+#include "SevenSegment.h"
 
 
-#define ZERO    0b1111110000000000 // 0
-#define ONE     0b0110000000000000 // 1
-#define TWO     0b1101101000000000 // 2
-#define THREE   0b1111001000000000 // 3
-#define FOUR    0b0110011000000000 // 4
-#define FIVE    0b1011011000000000 // 5
-#define SIX     0b1011111000000000 // 6
-#define SEVEN   0b1110000000000000 // 7
-#define EIGHT   0b1111111000000000 // 8
-#define NINE    0b1111011000000000 // 9
-#define POINT   0b0000000100000000 // .
-#define BLANK   0b0000000000000000
-
-#define LETTER_A 0b1110111000000000
-#define LETTER_B 0b0011111000000000
-#define LETTER_C 0b1001110000000000
-#define LETTER_D 0b0111101000000000
-#define LETTER_E 0b1001111000000000
-#define LETTER_F 0b1000111000000000
-#define LETTER_G 0b1011110000000000
-#define LETTER_H 0b0110111000000000
-#define LETTER_I 0b0000110000000000
-#define LETTER_J 0b0111100000000000
-#define LETTER_K 0b1010111000000000
-#define LETTER_L 0b0001110000000000
-#define LETTER_M 0b1010100000000000
-#define LETTER_N 0b1110110000000000
-#define LETTER_O 0b1111110000000000
-#define LETTER_P 0b1100111000000000
-#define LETTER_Q 0b1110011000000000
-#define LETTER_R 0b1100110000000000
-#define LETTER_S 0b1011011000000000
-#define LETTER_T 0b0001111000000000
-#define LETTER_U 0b0111110000000000
-#define LETTER_V 0b0111010000000000
-#define LETTER_W 0b0101010000000000
-#define LETTER_X 0b0110110000000000
-#define LETTER_Y 0b0111011000000000
-#define LETTER_Z 0b1101001000000000
-
-#define DASH 0b0000001000000000
 
 #define LED_TPI 1
 #define LED_INCH (1<<1)
@@ -118,6 +78,27 @@ typedef union KEY_REG
     struct KEY_BITS bit;
 } KEY_REG;
 
+// Key event types
+#define KEY_PRESS       0   // a key went down with no other key held
+#define KEY_REPEAT      1   // an auto-repeating key is still held
+#define KEY_LONG_PRESS  2   // a key has been held for KEY_LONG_PRESS_MS
+
+typedef struct KEY_EVENT
+{
+    KEY_REG key;
+    Uint16 type;
+} KEY_EVENT;
+
+// Key events that can wait for the user interface
+#define KEY_QUEUE_LENGTH 8
+
+
+// TM1638 display RAM: a digit and an LED byte for each of the 8 grids
+#define DISPLAY_GRID_SIZE 16
+
+// Worst case display update: brightness, data command and every address
+#define DISPLAY_MAX_STEPS (2 + DISPLAY_GRID_SIZE)
+
 
 class ControlPanel
 {
@@ -137,9 +118,24 @@ private:
     // current key states
     KEY_REG keys;
 
-    // number of times current key state has been seen
+    // when the current key went down and when it next repeats, as timer 2
+    // counts; keyActive is false if it didn't go down from no keys
+    bool keyActive;
+    Uint32 pressTime;
+    Uint32 repeatTime;
+    Uint32 repeatInterval;
+    bool longPressed;
+
+    // key events waiting for the user interface, oldest first
+    KEY_EVENT keyQueue[KEY_QUEUE_LENGTH];
+    Uint16 keyQueueHead;
+    Uint16 keyQueueCount;
+
+    // last key state read, when it was first seen, and whether it has held
+    // for the debounce time since
     KEY_REG stableKeys;
-    Uint16 stableCount;
+    Uint32 stableTime;
+    bool settled;
 
     // current override message, or NULL if none
     const Uint16 *message;
@@ -150,19 +146,30 @@ private:
     // Derived state, calculated internally
     Uint16 sevenSegmentData[8];
 
-    // dummy register, for SPI
-    Uint16 dummy;
+    // display frame, streamed by DMA from a buffer in ControlPanel.cpp
+    SPI_STEP displaySteps[DISPLAY_MAX_STEPS];
+    SPI_TRANSACTION displayTransaction;
+
+    // what the TM1638 was last sent, so only changes go out
+    Uint16 sentBrightness;
+    Uint16 sentGrid[DISPLAY_GRID_SIZE];
+    bool sentValid;
+    Uint16 resyncCount;
+
+    // key scan commands and the four bytes read back
+    Uint16 keyCommands[2];
+    Uint16 keyData[4];
+    SPI_STEP keySteps[3];
+    SPI_TRANSACTION keyTransaction;
+    bool keysRead;
 
     void decomposeRPM(void);
     void decomposeValue(void);
-    KEY_REG readKeys(void);
-    Uint16 lcd_char(Uint16 x);
-    void sendByte(Uint16 data);
-    Uint16 receiveByte(void);
+    bool readKeys(KEY_REG *keys);
+    void queueKeyEvent(KEY_REG key, Uint16 type);
     void sendData(void);
+    Uint16 *addDisplayStep(Uint16 *data, Uint16 count);
     Uint16 reverse_byte(Uint16 x);
-    void initSpi();
-    void configureSpiBus(void);
     bool isValidKeyState(KEY_REG);
     bool isStable(KEY_REG);
 
@@ -172,8 +179,13 @@ public:
     // initialize the hardware for operation
     void initHardware(void);
 
-    // poll the keys and return a mask
-    KEY_REG getKeys(void);
+    // poll the keys and queue any events; each call picks up the scan started
+    // by the previous one and starts another in the background.  Run at
+    // KEY_SCAN_RATE_HZ.
+    void scanKeys(void);
+
+    // take the oldest key event; false if there are none
+    bool getKeyEvent(KEY_EVENT *event);
 
     // set the RPM value to display
     void setRPM(Uint16 rpm);
@@ -190,7 +202,8 @@ public:
     // set a brightness value, 0 (off) to 8 (max)
     void setBrightness(Uint16 brightness);
 
-    // refresh the hardware display
+    // refresh the hardware display in the background; skipped if the last
+    // refresh is still going
     void refresh(void);
 };
 
@@ -29,20 +29,188 @@
 
 
 
+static void initRamp(MOTION_RAMP *ramp)
+{
+    ramp->target = 0;
+    ramp->position = 0;
+    ramp->speed = 0;
+    ramp->fraction = 0;
+    ramp->direction = 1;
+    ramp->ticks = 0;
+}
+
 Core :: Core( Encoder *encoder, StepperDrive *stepperDrive )
 {
     this->encoder = encoder;
     this->stepperDrive = stepperDrive;
 
+#ifdef USE_CROSS_SLIDE
+    this->crossSlideDrive = NULL;
+    this->crossSlideFeed = NULL;
+#ifdef USE_FLOATING_POINT
+    this->previousCrossSlideFeed = NULL;
+#endif // USE_FLOATING_POINT
+    this->crossSlideDirection = 1;
+    this->previousCrossSlideDirection = 1;
+#endif // USE_CROSS_SLIDE
+
+#ifdef USE_LEADSCREW_ENCODER
+    this->leadscrewEncoder = NULL;
+    this->feedbackTicks = 0;
+    this->feedbackResetPending = true;
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+    this->handwheel = NULL;
+    this->handwheelReference = 0;
+    this->handwheelDetents = 0;
+    initRamp(&this->jog);
+    this->jogEnabled = false;
+    this->jogScale = 1;
+#endif // USE_HANDWHEEL
+
+    initRamp(&this->resume);
+#ifdef USE_CROSS_SLIDE
+    initRamp(&this->crossSlideResume);
+#endif // USE_CROSS_SLIDE
+
+    this->sourceFeed = NULL;
+#ifdef USE_CROSS_SLIDE
+    this->sourceCrossSlideFeed = NULL;
+#endif // USE_CROSS_SLIDE
+    this->resolutionNumerator = 1;
+    this->resolutionDenominator = 1;
+
     this->feed = NULL;
     this->feedDirection = 0;
 
     this->previousSpindlePosition = 0;
+
+#ifdef USE_INDEX_CORRECTION
+    this->spindleOffset = 0;
+    this->indexCorrectionTicks = 0;
+#endif // USE_INDEX_CORRECTION
     this->previousFeedDirection = 0;
+
+#ifdef USE_FLOATING_POINT
     this->previousFeed = NULL;
+#else
+    this->feedGeneration = 0;
+    this->loadedFeedGeneration = 0;
+    this->feedNumerator = 0;
+    this->feedDenominator = 1;
+#ifdef USE_CROSS_SLIDE
+    this->crossSlideGeneration = 0;
+    this->loadedCrossSlideGeneration = 0;
+    this->crossSlideNumerator = 0;
+    this->crossSlideDenominator = 1;
+#endif // USE_CROSS_SLIDE
+
+    this->scaledFeedIndex = 0;
+#ifdef USE_CROSS_SLIDE
+    this->scaledCrossSlideFeedIndex = 0;
+#endif // USE_CROSS_SLIDE
+#endif // USE_FLOATING_POINT
 
     this->powerOn = true; // default to power on
+
+    this->alarmLatched = false;
+    this->alarmClearPending = false;
+
+    this->idle = false;
+    this->idleTicks = 0;
+    this->wakeCount = 0;
+    this->wakeLatencyUs = 0;
+    this->maxWakeLatencyUs = 0;
+}
+
+#ifdef USE_CROSS_SLIDE
+void Core :: setCrossSlideDrive(StepperDrive *crossSlideDrive)
+{
+    this->crossSlideDrive = crossSlideDrive;
+}
+
+void Core :: setCrossSlideFeed(const FEED_THREAD *feed, bool reverse)
+{
+    this->sourceCrossSlideFeed = feed;
+    this->crossSlideDirection = reverse ? -1 : 1;
+#ifdef USE_FLOATING_POINT
+    this->crossSlideFeed = (feed == NULL) ? 0 : (float)feed->numerator / feed->denominator * resolutionNumerator / resolutionDenominator;
+#else
+    this->crossSlideFeed = scaleFeed(feed, scaledCrossSlideFeeds, &scaledCrossSlideFeedIndex);
+    this->crossSlideGeneration++;
+#endif // USE_FLOATING_POINT
+}
+#endif // USE_CROSS_SLIDE
+
+void Core :: setFeed(const FEED_THREAD *feed)
+{
+    this->sourceFeed = feed;
+#ifdef USE_FLOATING_POINT
+    this->feed = (float)feed->numerator / feed->denominator * resolutionNumerator / resolutionDenominator;
+#else
+    this->feed = scaleFeed(feed, scaledFeeds, &scaledFeedIndex);
+    this->feedGeneration++;
+#endif // USE_FLOATING_POINT
+}
+
+#ifndef USE_FLOATING_POINT
+const FEED_THREAD *Core :: scaleFeed(const FEED_THREAD *feed, FEED_THREAD *buffers, Uint16 *index)
+{
+    if( feed == NULL || resolutionNumerator == resolutionDenominator ) {
+        return feed;
+    }
+
+    Uint64 numerator = feed->numerator * resolutionNumerator;
+    Uint64 denominator = feed->denominator * resolutionDenominator;
+    reduceRatio(&numerator, &denominator, FEED_THREAD_MAX_TERM);
+
+    // fill the buffer the ISR isn't using
+    FEED_THREAD *scaled = &buffers[*index];
+    *index = 1 - *index;
+
+    *scaled = *feed;
+    scaled->numerator = numerator;
+    scaled->denominator = denominator;
+    return scaled;
+}
+#endif // USE_FLOATING_POINT
+
+void Core :: setEncoderResolution(Uint16 resolution)
+{
+    Uint64 numerator = ENCODER_RESOLUTION;
+    Uint64 denominator = resolution;
+    reduceRatio(&numerator, &denominator, FEED_THREAD_MAX_TERM);
+
+    this->resolutionNumerator = numerator;
+    this->resolutionDenominator = denominator;
+    encoder->setResolution(resolution);
+
+    // rebuild whatever ratios are already set
+    if( this->sourceFeed != NULL ) {
+        setFeed(this->sourceFeed);
+    }
+#ifdef USE_CROSS_SLIDE
+    setCrossSlideFeed(this->sourceCrossSlideFeed, this->crossSlideDirection < 0);
+#endif // USE_CROSS_SLIDE
+}
+
+#ifdef USE_LEADSCREW_ENCODER
+void Core :: setLeadscrewEncoder(LeadscrewEncoder *leadscrewEncoder)
+{
+    this->leadscrewEncoder = leadscrewEncoder;
+}
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+void Core :: setHandwheel(Handwheel *handwheel)
+{
+    this->handwheel = handwheel;
+
+    // whatever the wheel reads now is the starting point
+    this->handwheelReference = handwheel->getPosition();
 }
+#endif // USE_HANDWHEEL
 
 void Core :: setReverse(bool reverse)
 {
@@ -60,6 +228,13 @@ void Core :: setPowerOn(bool powerOn)
 {
     this->powerOn = powerOn;
     this->stepperDrive->setEnabled(powerOn);
+#ifdef USE_CROSS_SLIDE
+    this->crossSlideDrive->setEnabled(powerOn);
+#endif // USE_CROSS_SLIDE
+#ifdef USE_LEADSCREW_ENCODER
+    // the carriage may have been moved by hand while the drive was off
+    this->feedbackResetPending = true;
+#endif // USE_LEADSCREW_ENCODER
 }
 
 
@@ -31,6 +31,45 @@
 #include "Encoder.h"
 #include "ControlPanel.h"
 #include "Tables.h"
+#ifdef USE_LEADSCREW_ENCODER
+#include "LeadscrewEncoder.h"
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_HANDWHEEL
+#include "Handwheel.h"
+#endif // USE_HANDWHEEL
+
+// Number of ISR ticks between closed-loop position checks (1kHz)
+#define FEEDBACK_CHECK_TICKS (1000 / STEPPER_CYCLE_US)
+
+// Number of ISR ticks between one-count index corrections (1kHz)
+#define INDEX_CORRECTION_TICKS (1000 / STEPPER_CYCLE_US)
+
+// Number of full-speed ISR ticks with nothing moving before going idle
+#define IDLE_TICKS ((Uint32)IDLE_DELAY_MS * 1000 / STEPPER_CYCLE_US)
+
+// Number of ISR ticks between ramp speed updates (1kHz)
+#define RAMP_TICKS (1000 / STEPPER_CYCLE_US)
+
+// Ramp speed in steps per ISR tick, 16.16 fixed point, from steps per second,
+// and the change in it at each speed update, from steps per second per second
+#define RAMP_SPEED(rate) ((Uint32)((Uint64)(rate) * STEPPER_CYCLE_US * 65536 / 1000000))
+#define RAMP_ACCELERATION(acceleration) ((Uint32)((Uint64)(acceleration) * STEPPER_CYCLE_US * 65536 / 1000000000))
+
+// Braking has to start when distance * RAMP_BRAKE_FACTOR <= speed^2
+#define RAMP_BRAKE_FACTOR(acceleration) ((Uint32)((Uint64)2 * RAMP_ACCELERATION(acceleration) * 65536 / RAMP_TICKS))
+
+
+// An offset on top of the synchronized position, moved towards its target at
+// a bounded speed and acceleration, since StepperDrive has no ramp of its own
+typedef struct MOTION_RAMP
+{
+    int32 target;
+    int32 position;
+    Uint32 speed;           // steps per ISR tick, 16.16
+    Uint32 fraction;        // part step carried over, 16.16
+    int16 direction;
+    Uint16 ticks;           // ticks since the last speed update
+} MOTION_RAMP;
 
 
 class Core
@@ -38,44 +77,244 @@ class Core
 private:
     Encoder *encoder;
     StepperDrive *stepperDrive;
+#ifdef USE_CROSS_SLIDE
+    StepperDrive *crossSlideDrive;
+#endif // USE_CROSS_SLIDE
+#ifdef USE_LEADSCREW_ENCODER
+    LeadscrewEncoder *leadscrewEncoder;
+    Uint16 feedbackTicks;
+    bool feedbackResetPending;
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_HANDWHEEL
+    Handwheel *handwheel;
+
+    // handwheel count already turned into detents
+    Uint32 handwheelReference;
+    Uint32 handwheelDetents;
+
+    // leadscrew offset jogged in by hand, added to the synchronized position;
+    // the wheel sets the target and the offset ramps towards it
+    MOTION_RAMP jog;
+    bool jogEnabled;
+    Uint16 jogScale;
+#endif // USE_HANDWHEEL
+
+    // offsets that bring the drives back to the synchronized position after
+    // an alarm; they start at the gap and ramp to zero
+    MOTION_RAMP resume;
+#ifdef USE_CROSS_SLIDE
+    MOTION_RAMP crossSlideResume;
+#endif // USE_CROSS_SLIDE
+
+    void rampISR(MOTION_RAMP *ramp, Uint32 maxSpeed, Uint32 acceleration, Uint32 brakeFactor);
+    void stopRamp(MOTION_RAMP *ramp);
+    bool isRamping(MOTION_RAMP *ramp);
+    void resetRamp(MOTION_RAMP *ramp);
+    void startResume(MOTION_RAMP *ramp, StepperDrive *drive);
+
+    // ratios as set, before scaling for a measured encoder resolution
+    const FEED_THREAD *sourceFeed;
+#ifdef USE_CROSS_SLIDE
+    const FEED_THREAD *sourceCrossSlideFeed;
+#endif // USE_CROSS_SLIDE
+
+    // the feed tables assume ENCODER_RESOLUTION; ratios are scaled by this
+    // to suit the encoder actually fitted
+    Uint16 resolutionNumerator;
+    Uint16 resolutionDenominator;
 
 #ifdef USE_FLOATING_POINT
     float feed;
     float previousFeed;
+#ifdef USE_CROSS_SLIDE
+    float crossSlideFeed;
+    float previousCrossSlideFeed;
+#endif // USE_CROSS_SLIDE
 #else
     const FEED_THREAD *feed;
-    const FEED_THREAD *previousFeed;
+#ifdef USE_CROSS_SLIDE
+    const FEED_THREAD *crossSlideFeed;
+#endif // USE_CROSS_SLIDE
+
+    // bumped each time a ratio is set; ratios can be rewritten in place, so
+    // the pointer alone doesn't tell the ISR when to reload
+    Uint16 feedGeneration;
+#ifdef USE_CROSS_SLIDE
+    Uint16 crossSlideGeneration;
+#endif // USE_CROSS_SLIDE
+
+    // RAM copies of the active ratios; the tables themselves live in flash
+    Uint16 loadedFeedGeneration;
+    Uint64 feedNumerator;
+    Uint64 feedDenominator;
+#ifdef USE_CROSS_SLIDE
+    Uint16 loadedCrossSlideGeneration;
+    Uint64 crossSlideNumerator;
+    Uint64 crossSlideDenominator;
+#endif // USE_CROSS_SLIDE
+
+    // scaled ratios, double-buffered so the ISR never sees a half-written one
+    FEED_THREAD scaledFeeds[2];
+    Uint16 scaledFeedIndex;
+#ifdef USE_CROSS_SLIDE
+    FEED_THREAD scaledCrossSlideFeeds[2];
+    Uint16 scaledCrossSlideFeedIndex;
+#endif // USE_CROSS_SLIDE
+
+    const FEED_THREAD *scaleFeed(const FEED_THREAD *feed, FEED_THREAD *buffers, Uint16 *index);
 #endif // USE_FLOATING_POINT
 
+    // pick up a newly set ratio; true if it differs from the one in use
+    bool loadFeed(void);
+#ifdef USE_CROSS_SLIDE
+    bool loadCrossSlideFeed(void);
+#endif // USE_CROSS_SLIDE
+
     int16 feedDirection;
     int16 previousFeedDirection;
+#ifdef USE_CROSS_SLIDE
+    // cross-slide direction relative to the leadscrew
+    int16 crossSlideDirection;
+    int16 previousCrossSlideDirection;
+#endif // USE_CROSS_SLIDE
 
     Uint32 previousSpindlePosition;
 
+#ifdef USE_INDEX_CORRECTION
+    // part of the encoder's index correction applied so far, in counts
+    int32 spindleOffset;
+    Uint16 indexCorrectionTicks;
+
+    void indexCorrectionISR(void);
+#endif // USE_INDEX_CORRECTION
+
     int32 feedRatio(Uint32 count);
+#ifdef USE_CROSS_SLIDE
+    int32 crossSlideRatio(Uint32 count);
+    void crossSlideISR(Uint32 spindlePosition);
+#endif // USE_CROSS_SLIDE
+
+#ifdef USE_LEADSCREW_ENCODER
+    void feedbackISR(void);
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+    void handwheelISR(void);
+#endif // USE_HANDWHEEL
 
     bool powerOn;
 
+    // alarm latched by the ISR; stepping is frozen until it is cleared
+    bool alarmLatched;
+    bool alarmClearPending;
+
+    void alarmISR(void);
+
+    // latched faults; unlike drive alarms these stay until the operator clears them
+    bool isFault(void);
+    void clearFaults(void);
+
+    // idle tracking, so the ISR can drop to a slow poll when nothing is moving
+    bool idle;
+    Uint32 idleTicks;
+    Uint32 wakeCount;
+    Uint32 wakeLatencyUs;
+    Uint32 maxWakeLatencyUs;
+
+    bool isMoving(void);
+    void idleISR(bool spindleMoved);
+
 public:
     Core( Encoder *encoder, StepperDrive *stepperDrive );
 
+#ifdef USE_CROSS_SLIDE
+    // attach the cross-slide drive; must be called before interrupts are enabled
+    void setCrossSlideDrive(StepperDrive *crossSlideDrive);
+
+    // set the cross-slide ratio, in cross-slide steps per encoder count, and
+    // whether it moves against the leadscrew; NULL to hold
+    void setCrossSlideFeed(const FEED_THREAD *feed, bool reverse);
+#endif // USE_CROSS_SLIDE
+
+#ifdef USE_LEADSCREW_ENCODER
+    // attach the leadscrew encoder; must be called before interrupts are enabled
+    void setLeadscrewEncoder(LeadscrewEncoder *leadscrewEncoder);
+
+    // closed-loop statistics
+    Uint32 getCorrectionSteps(void);
+    int32 getMaxFollowingError(void);
+
+    // true while the alarm is latched because the carriage lost position
+    bool isFeedbackFault(void);
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+    // attach the handwheel; must be called before interrupts are enabled
+    void setHandwheel(Handwheel *handwheel);
+
+    // allow the handwheel to move the leadscrew, at scale times
+    // HANDWHEEL_STEPS_PER_DETENT steps per detent
+    void setJogEnabled(bool enabled);
+    void setJogScale(Uint16 scale);
+
+    // detents turned since startup, whether or not they moved anything
+    Uint32 getHandwheelDetents(void);
+#endif // USE_HANDWHEEL
+
     void setFeed(const FEED_THREAD *feed);
     void setReverse(bool reverse);
+
+    // use a measured encoder resolution instead of ENCODER_RESOLUTION; the
+    // current ratios are rebuilt to suit
+    void setEncoderResolution(Uint16 resolution);
+
+    // leadscrew steps per spindle revolution at the current feed
+    Uint32 getStepsPerRev(void);
     Uint16 getRPM(void);
+
+#ifdef USE_INDEX_CORRECTION
+    // index correction applied so far, in counts; it trails the encoder's
+    // correction while it is eased in
+    int32 getSpindleOffset(void);
+#endif // USE_INDEX_CORRECTION
+
+    // true while a drive is reporting an alarm; faults found by the firmware
+    // itself latch the alarm too, but don't show up here
     bool isAlarm();
 
+    // true from the moment an alarm is seen until it is cleared by the operator
+    bool isAlarmLatched();
+
+    // resume synchronized motion after an alarm, once the drive alarm is gone;
+    // the drives ramp back to the position sync has reached in the meantime
+    void clearAlarm();
+
     bool isPowerOn();
     void setPowerOn(bool);
 
+    // true when the ISR can drop to a slow poll
+    bool isIdle();
+
+    // wake statistics: number of wake-ups, and the time from the first
+    // encoder edge to the tick that handled it, last and longest
+    Uint32 getWakeCount();
+    Uint32 getWakeLatencyUs();
+    Uint32 getMaxWakeLatencyUs();
+
     void ISR( void );
 };
 
-inline void Core :: setFeed(const FEED_THREAD *feed)
+inline Uint32 Core :: getStepsPerRev(void)
 {
+    // encoder counts per spindle revolution allow for a geared encoder
 #ifdef USE_FLOATING_POINT
-    this->feed = (float)feed->numerator / feed->denominator;
+    return this->feed * encoder->getResolution() * ENCODER_GEAR_NUMERATOR / ENCODER_GEAR_DENOMINATOR;
 #else
-    this->feed = feed;
+    const FEED_THREAD *current = this->feed;
+    if( current == NULL ) {
+        return 0;
+    }
+    return current->numerator * encoder->getResolution() * ENCODER_GEAR_NUMERATOR / (current->denominator * ENCODER_GEAR_DENOMINATOR);
 #endif // USE_FLOATING_POINT
 }
 
@@ -84,9 +323,57 @@ inline Uint16 Core :: getRPM(void)
     return encoder->getRPM();
 }
 
+#ifdef USE_INDEX_CORRECTION
+inline int32 Core :: getSpindleOffset(void)
+{
+    return this->spindleOffset;
+}
+#endif // USE_INDEX_CORRECTION
+
+#pragma FUNC_ALWAYS_INLINE
 inline bool Core :: isAlarm()
 {
-    return this->stepperDrive->isAlarm();
+    bool alarm = this->stepperDrive->isAlarm();
+#ifdef USE_CROSS_SLIDE
+    alarm = alarm || this->crossSlideDrive->isAlarm();
+#endif // USE_CROSS_SLIDE
+    return alarm;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Core :: isFault(void)
+{
+    bool fault = false;
+#ifdef USE_LEADSCREW_ENCODER
+    fault = fault || this->stepperDrive->isFeedbackFault();
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_INDEX_CORRECTION
+    fault = fault || this->encoder->isIndexFault();
+#endif // USE_INDEX_CORRECTION
+    return fault;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: clearFaults(void)
+{
+#ifdef USE_LEADSCREW_ENCODER
+    // the carriage position after a fault is what it is; measure from here
+    stepperDrive->resetFeedback(leadscrewEncoder->getSteps());
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_INDEX_CORRECTION
+    encoder->clearIndexFault();
+#endif // USE_INDEX_CORRECTION
+}
+
+inline bool Core :: isAlarmLatched()
+{
+    return this->alarmLatched;
+}
+
+inline void Core :: clearAlarm()
+{
+    // handled in the ISR, so the feedback reference and latch change together
+    this->alarmClearPending = true;
 }
 
 inline bool Core :: isPowerOn()
@@ -94,23 +381,419 @@ inline bool Core :: isPowerOn()
     return this->powerOn;
 }
 
+#pragma FUNC_ALWAYS_INLINE
+inline bool Core :: loadFeed(void)
+{
+#ifdef USE_FLOATING_POINT
+    bool changed = feed != previousFeed;
+    previousFeed = feed;
+    return changed;
+#else
+    if( feedGeneration == loadedFeedGeneration ) {
+        return false;
+    }
+    loadedFeedGeneration = feedGeneration;
+
+    const FEED_THREAD *newFeed = feed;
+    bool changed = newFeed->numerator != feedNumerator || newFeed->denominator != feedDenominator;
+    feedNumerator = newFeed->numerator;
+    feedDenominator = newFeed->denominator;
+    return changed;
+#endif // USE_FLOATING_POINT
+}
+
+#pragma FUNC_ALWAYS_INLINE
 inline int32 Core :: feedRatio(Uint32 count)
 {
 #ifdef USE_FLOATING_POINT
     return ((float)count) * this->feed * feedDirection;
 #else // USE_FLOATING_POINT
-    return ((long long)count) * feed->numerator / feed->denominator * feedDirection;
+    return ((long long)count) * feedNumerator / feedDenominator * feedDirection;
+#endif // USE_FLOATING_POINT
+}
+
+#ifdef USE_CROSS_SLIDE
+#pragma FUNC_ALWAYS_INLINE
+inline int32 Core :: crossSlideRatio(Uint32 count)
+{
+#ifdef USE_FLOATING_POINT
+    return ((float)count) * this->crossSlideFeed * feedDirection * crossSlideDirection;
+#else // USE_FLOATING_POINT
+    return ((long long)count) * crossSlideNumerator / crossSlideDenominator * feedDirection * crossSlideDirection;
+#endif // USE_FLOATING_POINT
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Core :: loadCrossSlideFeed(void)
+{
+#ifdef USE_FLOATING_POINT
+    bool changed = crossSlideFeed != previousCrossSlideFeed;
+    previousCrossSlideFeed = crossSlideFeed;
+    return changed;
+#else
+    if( crossSlideGeneration == loadedCrossSlideGeneration ) {
+        return false;
+    }
+    loadedCrossSlideGeneration = crossSlideGeneration;
+
+    const FEED_THREAD *newFeed = crossSlideFeed;
+    if( newFeed == NULL ) {
+        // forget the old ratio, so picking it up again resets sync
+        crossSlideNumerator = 0;
+        return true;
+    }
+    bool changed = newFeed->numerator != crossSlideNumerator || newFeed->denominator != crossSlideDenominator;
+    crossSlideNumerator = newFeed->numerator;
+    crossSlideDenominator = newFeed->denominator;
+    return changed;
 #endif // USE_FLOATING_POINT
 }
 
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: crossSlideISR(Uint32 spindlePosition)
+{
+    // pick up a new ratio before using it
+    bool feedChanged = loadCrossSlideFeed();
+
+    if( this->crossSlideFeed != NULL ) {
+
+        // calculate the desired cross-slide position from the same spindle
+        // reading, plus whatever is left of the way back after an alarm
+        int32 desiredSteps = crossSlideRatio(spindlePosition);
+        bool resync = feedChanged || feedDirection != previousFeedDirection
+            || crossSlideDirection != previousCrossSlideDirection;
+        if( resync || ! powerOn ) {
+            resetRamp(&crossSlideResume);
+        }
+        else if( ! alarmLatched ) {
+            rampISR(&crossSlideResume, RAMP_SPEED(RESUME_MAX_RATE), RAMP_ACCELERATION(RESUME_ACCELERATION),
+                    RAMP_BRAKE_FACTOR(RESUME_ACCELERATION));
+        }
+        desiredSteps += crossSlideResume.position;
+        crossSlideDrive->setDesiredPosition(desiredSteps);
+
+        // compensate for encoder overflow/underflow
+        if( spindlePosition < previousSpindlePosition && previousSpindlePosition - spindlePosition > encoder->getMaxCount()/2 ) {
+            crossSlideDrive->incrementCurrentPosition(-1 * crossSlideRatio(encoder->getMaxCount()));
+        }
+        if( spindlePosition > previousSpindlePosition && spindlePosition - previousSpindlePosition > encoder->getMaxCount()/2 ) {
+            crossSlideDrive->incrementCurrentPosition(crossSlideRatio(encoder->getMaxCount()));
+        }
+
+        // if the ratio or direction changed, reset sync to avoid a big step
+        if( resync ) {
+            crossSlideDrive->setCurrentPosition(desiredSteps);
+        }
+    }
+
+    previousCrossSlideDirection = crossSlideDirection;
+}
+#endif // USE_CROSS_SLIDE
+
+#ifdef USE_LEADSCREW_ENCODER
+inline Uint32 Core :: getCorrectionSteps(void)
+{
+    return this->stepperDrive->getCorrectionSteps();
+}
+
+inline int32 Core :: getMaxFollowingError(void)
+{
+    return this->stepperDrive->getMaxFollowingError();
+}
+
+inline bool Core :: isFeedbackFault(void)
+{
+    return this->stepperDrive->isFeedbackFault();
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: feedbackISR(void)
+{
+    // the check is much more expensive than a stepper tick, so run it at a lower rate
+    if( ++feedbackTicks >= FEEDBACK_CHECK_TICKS ) {
+        feedbackTicks = 0;
+
+        if( feedbackResetPending ) {
+            stepperDrive->resetFeedback(leadscrewEncoder->getSteps());
+            feedbackResetPending = false;
+        }
+        else {
+            stepperDrive->correctPosition(leadscrewEncoder->getSteps());
+        }
+    }
+}
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+inline void Core :: setJogEnabled(bool enabled)
+{
+    this->jogEnabled = enabled;
+}
+
+inline void Core :: setJogScale(Uint16 scale)
+{
+    this->jogScale = scale;
+}
+
+inline Uint32 Core :: getHandwheelDetents(void)
+{
+    return this->handwheelDetents;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: handwheelISR(void)
+{
+    // the counter wraps at 32 bits, so the difference reads as signed
+    int32 counts = (int32)(handwheel->getPosition() - handwheelReference);
+
+    // only whole detents count; partial ones carry over to the next tick
+    if( counts >= HANDWHEEL_COUNTS_PER_DETENT || counts <= -HANDWHEEL_COUNTS_PER_DETENT ) {
+        int32 detents = counts / HANDWHEEL_COUNTS_PER_DETENT;
+        handwheelReference += detents * HANDWHEEL_COUNTS_PER_DETENT;
+        handwheelDetents += (detents < 0) ? -detents : detents;
+
+        // turning the wheel with the drive off or frozen does nothing, so the
+        // carriage never lurches when it comes back
+        if( jogEnabled && powerOn && ! alarmLatched ) {
+            jog.target += detents * jogScale * HANDWHEEL_STEPS_PER_DETENT;
+        }
+    }
+
+    if( ! powerOn || alarmLatched ) {
+        // and a jog in progress is dropped where it is
+        stopRamp(&jog);
+    }
+
+    rampISR(&jog, RAMP_SPEED(HANDWHEEL_MAX_RATE), RAMP_ACCELERATION(HANDWHEEL_ACCELERATION),
+            RAMP_BRAKE_FACTOR(HANDWHEEL_ACCELERATION));
+}
+#endif // USE_HANDWHEEL
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: rampISR(MOTION_RAMP *ramp, Uint32 maxSpeed, Uint32 acceleration, Uint32 brakeFactor)
+{
+    // adjust the speed once a millisecond: slow down when heading away from
+    // the target or when only the stopping distance is left, otherwise speed up
+    if( ++ramp->ticks >= RAMP_TICKS ) {
+        ramp->ticks = 0;
+
+        int32 remaining = ramp->target - ramp->position;
+        if( ramp->speed == 0 ) {
+            ramp->direction = (remaining < 0) ? -1 : 1;
+            ramp->fraction = 0;
+        }
+        int32 distance = remaining * ramp->direction;
+
+        // beyond this the product would overflow, and it is too far to brake anyway
+        Uint32 brakeLimit = 0xffffffff / brakeFactor;
+
+        if( distance <= 0 || ((Uint32)distance < brakeLimit && (Uint32)distance * brakeFactor <= ramp->speed * ramp->speed) ) {
+            ramp->speed = (ramp->speed > acceleration) ? ramp->speed - acceleration : 0;
+        }
+        else {
+            ramp->speed = (ramp->speed + acceleration < maxSpeed) ? ramp->speed + acceleration : maxSpeed;
+        }
+    }
+
+    // step the offset whenever the fraction carries
+    ramp->fraction += ramp->speed;
+    if( ramp->fraction >= 65536 ) {
+        ramp->fraction -= 65536;
+        ramp->position += ramp->direction;
+
+        if( ramp->position == ramp->target ) {
+            // braking brings the speed down to almost nothing by here
+            ramp->speed = 0;
+            ramp->fraction = 0;
+        }
+    }
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: stopRamp(MOTION_RAMP *ramp)
+{
+    ramp->target = ramp->position;
+    ramp->speed = 0;
+    ramp->fraction = 0;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Core :: isRamping(MOTION_RAMP *ramp)
+{
+    return ramp->position != ramp->target || ramp->speed != 0;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: resetRamp(MOTION_RAMP *ramp)
+{
+    ramp->position = 0;
+    stopRamp(ramp);
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: startResume(MOTION_RAMP *ramp, StepperDrive *drive)
+{
+    // the drive stopped where it was while sync carried on; start the offset at
+    // the gap, so nothing moves now, and ramp it out to close the gap
+    ramp->position += drive->getCurrentPosition() - drive->getDesiredPosition();
+    ramp->target = 0;
+    ramp->speed = 0;
+    ramp->fraction = 0;
+    drive->setDesiredPosition(drive->getCurrentPosition());
+}
+
+#ifdef USE_INDEX_CORRECTION
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: indexCorrectionISR(void)
+{
+    // ease the correction in a count at a time, so the carriage never jumps
+    if( ++indexCorrectionTicks >= INDEX_CORRECTION_TICKS ) {
+        indexCorrectionTicks = 0;
+
+        int32 target = encoder->getCountCorrection();
+        if( spindleOffset < target ) {
+            spindleOffset++;
+        }
+        else if( spindleOffset > target ) {
+            spindleOffset--;
+        }
+    }
+}
+#endif // USE_INDEX_CORRECTION
+
+inline bool Core :: isIdle()
+{
+    return this->idle;
+}
+
+inline Uint32 Core :: getWakeCount()
+{
+    return this->wakeCount;
+}
+
+inline Uint32 Core :: getWakeLatencyUs()
+{
+    return this->wakeLatencyUs;
+}
+
+inline Uint32 Core :: getMaxWakeLatencyUs()
+{
+    return this->maxWakeLatencyUs;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Core :: isMoving(void)
+{
+    bool moving = ! stepperDrive->isAtTarget();
+#ifdef USE_CROSS_SLIDE
+    moving = moving || ! crossSlideDrive->isAtTarget();
+#endif // USE_CROSS_SLIDE
+#ifdef USE_HANDWHEEL
+    moving = moving || isRamping(&jog);
+#endif // USE_HANDWHEEL
+    moving = moving || isRamping(&resume);
+#ifdef USE_CROSS_SLIDE
+    moving = moving || isRamping(&crossSlideResume);
+#endif // USE_CROSS_SLIDE
+    return moving;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: idleISR(bool spindleMoved)
+{
+    if( spindleMoved || isMoving() || alarmClearPending ) {
+        idleTicks = 0;
+    }
+    else if( idleTicks < IDLE_TICKS ) {
+        idleTicks++;
+    }
+
+    // with the power off, the drives just follow the spindle without stepping
+    bool nowIdle = ( ! powerOn && ! alarmClearPending ) || idleTicks >= IDLE_TICKS;
+
+    // take the first-edge time on every idle tick, so an edge that didn't
+    // wake anything isn't mistaken for the next one
+    Uint32 edgeTime;
+    bool edgeSeen = idle && encoder->takeWakeTime(&edgeTime);
+
+    if( idle && ! nowIdle && spindleMoved ) {
+        // woken by the encoder; timer 2 counts down, so the time since the
+        // first edge is the difference.  Without an edge the poll found the
+        // move, which only happens if it came in before the wake was armed.
+        if( edgeSeen ) {
+            wakeLatencyUs = (edgeTime - CpuTimer2Regs.TIM.all) / CPU_CLOCK_MHZ;
+            if( wakeLatencyUs > maxWakeLatencyUs ) {
+                maxWakeLatencyUs = wakeLatencyUs;
+            }
+        }
+        wakeCount++;
+    }
+
+    idle = nowIdle;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Core :: alarmISR(void)
+{
+    if( alarmClearPending ) {
+        clearFaults();
+        if( ! isAlarm() ) {
+            alarmLatched = false;
+
+            // pick up from where the drives were frozen
+            startResume(&resume, stepperDrive);
+#ifdef USE_CROSS_SLIDE
+            startResume(&crossSlideResume, crossSlideDrive);
+#endif // USE_CROSS_SLIDE
+        }
+        alarmClearPending = false;
+    }
+
+    if( isAlarm() || isFault() ) {
+        alarmLatched = true;
+    }
+}
+
+// Always inlined into cpu_timer0_isr, so the whole motion path runs from the
+// interrupt's code section and the interrupt makes no calls that would force
+// a full context save.  Every helper it reaches, here and in the drive,
+// encoder and debug classes, is marked the same way: plain inline is only a
+// hint, and one that stayed out of line would run from flash.
+#pragma FUNC_ALWAYS_INLINE
 inline void Core :: ISR( void )
 {
     if( this->feed != NULL ) {
+        // copy a new ratio out of the table once, rather than reading flash every tick
+        bool feedChanged = loadFeed();
+
         // read the encoder
         Uint32 spindlePosition = encoder->getPosition();
 
+#ifdef USE_INDEX_CORRECTION
+        // shift by the index correction; the count wraps at 24 bits, so mask to match
+        indexCorrectionISR();
+        spindlePosition = (spindlePosition + spindleOffset) & _ENCODER_MAX_COUNT;
+#endif // USE_INDEX_CORRECTION
+
         // calculate the desired stepper position
         int32 desiredSteps = feedRatio(spindlePosition);
+#ifdef USE_HANDWHEEL
+        // plus whatever has been jogged in by hand
+        handwheelISR();
+        desiredSteps += jog.position;
+#endif // USE_HANDWHEEL
+
+        // plus whatever is left of the way back after an alarm; a sync reset or
+        // the power going off makes that moot
+        bool resync = feedChanged || feedDirection != previousFeedDirection;
+        if( resync || ! powerOn ) {
+            resetRamp(&resume);
+        }
+        else if( ! alarmLatched ) {
+            rampISR(&resume, RAMP_SPEED(RESUME_MAX_RATE), RAMP_ACCELERATION(RESUME_ACCELERATION),
+                    RAMP_BRAKE_FACTOR(RESUME_ACCELERATION));
+        }
+        desiredSteps += resume.position;
         stepperDrive->setDesiredPosition(desiredSteps);
 
         // compensate for encoder overflow/underflow
@@ -122,17 +805,57 @@ inline void Core :: ISR( void )
         }
 
         // if the feed or direction changed, reset sync to avoid a big step
-        if( feed != previousFeed || feedDirection != previousFeedDirection) {
+        if( resync ) {
             stepperDrive->setCurrentPosition(desiredSteps);
         }
 
+#ifdef USE_CROSS_SLIDE
+        // update the cross-slide from the same spindle reading, before we forget the previous one
+        crossSlideISR(spindlePosition);
+#endif // USE_CROSS_SLIDE
+
+        // latch any drive alarm before deciding whether to step
+        alarmISR();
+
+#ifdef USE_LEADSCREW_ENCODER
+        // compare the commanded position against the leadscrew encoder, but
+        // only while the drive is enabled and running
+        if( powerOn && ! alarmLatched ) {
+            feedbackISR();
+        }
+#endif // USE_LEADSCREW_ENCODER
+
         // remember values for next time
+        bool spindleMoved = spindlePosition != previousSpindlePosition;
         previousSpindlePosition = spindlePosition;
         previousFeedDirection = feedDirection;
-        previousFeed = feed;
 
-        // service the stepper drive state machine
-        stepperDrive->ISR();
+        if( alarmLatched ) {
+            // freeze both axes; the desired positions keep tracking the spindle,
+            // and clearing the alarm ramps the drives back to them
+            stepperDrive->holdISR();
+#ifdef USE_CROSS_SLIDE
+            crossSlideDrive->holdISR();
+#endif // USE_CROSS_SLIDE
+        }
+        else if( ! powerOn ) {
+            // the drives are disabled, so follow the spindle without stepping;
+            // there is nothing to catch up when the power comes back on
+            stepperDrive->followISR();
+#ifdef USE_CROSS_SLIDE
+            crossSlideDrive->followISR();
+#endif // USE_CROSS_SLIDE
+        }
+        else {
+            // service the stepper drive state machines in the same tick
+            stepperDrive->ISR();
+#ifdef USE_CROSS_SLIDE
+            crossSlideDrive->ISR();
+#endif // USE_CROSS_SLIDE
+        }
+
+        // decide whether the next tick can be a slow poll
+        idleISR(spindleMoved);
     }
 }
 
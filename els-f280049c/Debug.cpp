@@ -27,9 +27,24 @@
 #include "Debug.h"
 
 
+#ifdef MEASURE_STEP_JITTER
+// Upper limits of each bucket but the last
+const Uint16 JITTER_RPM_LIMITS[JITTER_RPM_BUCKETS - 1] = { 100, 300, 1000 };
+const Uint32 JITTER_FEED_LIMITS[JITTER_FEED_BUCKETS - 1] = { 400, 1600, 6400 };
+#endif // MEASURE_STEP_JITTER
+
+
 Debug :: Debug( void )
 {
+    this->isrCycles = 0;
+    this->maxIsrCycles = 0;
+    this->taskOverruns = 0;
+    this->taskSkipped = 0;
 
+#ifdef MEASURE_STEP_JITTER
+    resetJitter();
+    this->jitterBucket = &this->jitter[0][0];
+#endif // MEASURE_STEP_JITTER
 }
 
 
@@ -45,3 +60,43 @@ void Debug :: initHardware( void )
     GpioDataRegs.GPACLEAR.bit.GPIO3 = 1;
     EDIS;
 }
+
+#ifdef MEASURE_STEP_JITTER
+void Debug :: selectJitterBucket( Uint16 rpm, Uint32 stepsPerRev )
+{
+    Uint16 rpmBucket = 0;
+    while( rpmBucket < JITTER_RPM_BUCKETS - 1 && rpm >= JITTER_RPM_LIMITS[rpmBucket] ) {
+        rpmBucket++;
+    }
+
+    Uint16 feedBucket = 0;
+    while( feedBucket < JITTER_FEED_BUCKETS - 1 && stepsPerRev >= JITTER_FEED_LIMITS[feedBucket] ) {
+        feedBucket++;
+    }
+
+    // a single pointer store, so the ISR always sees a whole bucket
+    this->jitterBucket = &this->jitter[rpmBucket][feedBucket];
+}
+
+Uint32 Debug :: getMeanJitterCycles( Uint16 rpmBucket, Uint16 feedBucket )
+{
+    const JITTER_STATS *stats = &this->jitter[rpmBucket][feedBucket];
+
+    if( stats->count == 0 ) {
+        return 0;
+    }
+    return stats->totalCycles / stats->count;
+}
+
+void Debug :: resetJitter( void )
+{
+    for( Uint16 i = 0; i < JITTER_RPM_BUCKETS; i++ ) {
+        for( Uint16 j = 0; j < JITTER_FEED_BUCKETS; j++ ) {
+            this->jitter[i][j].minCycles = 0xffffffff;
+            this->jitter[i][j].maxCycles = 0;
+            this->jitter[i][j].totalCycles = 0;
+            this->jitter[i][j].count = 0;
+        }
+    }
+}
+#endif // MEASURE_STEP_JITTER
@@ -28,9 +28,43 @@
 #define __DEBUG_H
 
 #include "F28x_Project.h"
+#include "Configuration.h"
+
+
+#ifdef MEASURE_STEP_JITTER
+// Step edge statistics are kept separately for ranges of spindle speed and of
+// feed (leadscrew steps per spindle revolution), since both change how much
+// work the ISR does before it gets to the edge
+#define JITTER_RPM_BUCKETS 4
+#define JITTER_FEED_BUCKETS 4
+
+typedef struct JITTER_STATS
+{
+    // CPU cycles from the timer tick to the STEP rising edge
+    Uint32 minCycles;
+    Uint32 maxCycles;
+    Uint64 totalCycles;
+    Uint32 count;
+} JITTER_STATS;
+#endif // MEASURE_STEP_JITTER
+
 
 class Debug
 {
+private:
+    // ISR execution time, in CPU cycles since the timer tick
+    Uint32 isrCycles;
+    Uint32 maxIsrCycles;
+
+    // main loop task counters, copied from the scheduler by the telemetry task
+    Uint32 taskOverruns;
+    Uint32 taskSkipped;
+
+#ifdef MEASURE_STEP_JITTER
+    JITTER_STATS jitter[JITTER_RPM_BUCKETS][JITTER_FEED_BUCKETS];
+    JITTER_STATS *jitterBucket;
+#endif // MEASURE_STEP_JITTER
+
 public:
     Debug(void);
     void initHardware(void);
@@ -42,14 +76,39 @@ public:
     // analyzer pin 2
     void begin2( void );
     void end2( void );
+
+    // ISR timing, measured against the CPU timer 0 tick
+    void recordIsrTime( void );
+    Uint32 getIsrCycles( void );
+    Uint32 getMaxIsrCycles( void );
+    void resetIsrTime( void );
+
+    // main loop health: task runs that overran their period, or were dropped
+    void recordTaskCounts( Uint32 overruns, Uint32 skipped );
+    Uint32 getTaskOverruns( void );
+    Uint32 getTaskSkipped( void );
+
+#ifdef MEASURE_STEP_JITTER
+    // step edge timing; the bucket is chosen from the main loop
+    void selectJitterBucket( Uint16 rpm, Uint32 stepsPerRev );
+    void recordStepEdge( Uint32 timer );
+    const JITTER_STATS *getJitterStats( Uint16 rpmBucket, Uint16 feedBucket );
+    const JITTER_STATS *getCurrentJitterStats( void );
+    Uint32 getMeanJitterCycles( Uint16 rpmBucket, Uint16 feedBucket );
+    void resetJitter( void );
+#endif // MEASURE_STEP_JITTER
 };
 
 
+// begin1, end1, recordIsrTime and recordStepEdge are called from the stepper
+// interrupt; see Core::ISR
+#pragma FUNC_ALWAYS_INLINE
 inline void Debug :: begin1( void )
 {
     GpioDataRegs.GPASET.bit.GPIO2 = 1;
 }
 
+#pragma FUNC_ALWAYS_INLINE
 inline void Debug :: end1( void )
 {
     GpioDataRegs.GPACLEAR.bit.GPIO2 = 1;
@@ -65,5 +124,79 @@ inline void Debug :: end2( void )
     GpioDataRegs.GPACLEAR.bit.GPIO3 = 1;
 }
 
+#pragma FUNC_ALWAYS_INLINE
+inline void Debug :: recordIsrTime( void )
+{
+    // timer 0 counts down from PRD, so this is the time since the tick fired,
+    // including interrupt latency
+    Uint32 cycles = CpuTimer0Regs.PRD.all - CpuTimer0Regs.TIM.all;
+
+    this->isrCycles = cycles;
+    if( cycles > this->maxIsrCycles ) {
+        this->maxIsrCycles = cycles;
+    }
+}
+
+inline Uint32 Debug :: getIsrCycles( void )
+{
+    return this->isrCycles;
+}
+
+inline Uint32 Debug :: getMaxIsrCycles( void )
+{
+    return this->maxIsrCycles;
+}
+
+inline void Debug :: resetIsrTime( void )
+{
+    this->maxIsrCycles = 0;
+}
+
+inline void Debug :: recordTaskCounts( Uint32 overruns, Uint32 skipped )
+{
+    this->taskOverruns = overruns;
+    this->taskSkipped = skipped;
+}
+
+inline Uint32 Debug :: getTaskOverruns( void )
+{
+    return this->taskOverruns;
+}
+
+inline Uint32 Debug :: getTaskSkipped( void )
+{
+    return this->taskSkipped;
+}
+
+#ifdef MEASURE_STEP_JITTER
+#pragma FUNC_ALWAYS_INLINE
+inline void Debug :: recordStepEdge( Uint32 timer )
+{
+    // timer 0 counts down from PRD, so this is how late the edge was relative
+    // to the tick that should have produced it
+    Uint32 cycles = CpuTimer0Regs.PRD.all - timer;
+    JITTER_STATS *stats = this->jitterBucket;
+
+    if( cycles < stats->minCycles ) {
+        stats->minCycles = cycles;
+    }
+    if( cycles > stats->maxCycles ) {
+        stats->maxCycles = cycles;
+    }
+    stats->totalCycles += cycles;
+    stats->count++;
+}
+
+inline const JITTER_STATS *Debug :: getJitterStats( Uint16 rpmBucket, Uint16 feedBucket )
+{
+    return &this->jitter[rpmBucket][feedBucket];
+}
+
+inline const JITTER_STATS *Debug :: getCurrentJitterStats( void )
+{
+    return this->jitterBucket;
+}
+#endif // MEASURE_STEP_JITTER
+
 
 #endif // __DEBUG_H
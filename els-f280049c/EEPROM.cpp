@@ -29,15 +29,28 @@
 // Raise the EEPROM CS line
 #define CS_RELEASE GpioDataRegs.GPBSET.bit.GPIO34 = 1
 
-// Lower the EEPROM CS line
-#define CS_ASSERT GpioDataRegs.GPBCLEAR.bit.GPIO34 = 1
+// EEPROM CS line, GPIO34
+#define CS_MASK ((Uint32)1 << (34 - 32))
 
 // enough time for the CS line to rise and be deteted
 #define CS_RISE_TIME_US 5
 
+// SPI bit rate = LSPCLK/128 ~ 98Kbps, shared with the control panel so far
+#define EEPROM_BIT_RATE 127
+
+// 16-bit words in 4-wire mode; a settings save goes ahead of display traffic
+static const SPI_DEVICE eepromDevice = { CS_MASK, SPI_SIXTEEN_BITS, EEPROM_BIT_RATE, SPI_PRIORITY_HIGH };
+
 EEPROM :: EEPROM(SPIBus *spiBus)
 {
     this->spiBus = spiBus;
+
+    this->transaction.device = &eepromDevice;
+    this->transaction.steps = this->steps;
+    this->transaction.stepCount = 0;
+    this->transaction.busy = false;
+
+    this->writeState = EEPROM_IDLE;
 }
 
 void EEPROM :: initHardware(void)
@@ -52,51 +65,56 @@ void EEPROM :: initHardware(void)
     EDIS;
 }
 
-void EEPROM :: configureSpiBus8Bit( void )
+void EEPROM :: addStep(Uint16 flags, Uint16 count, Uint16 *data)
 {
-    // configure the shared bus
-    this->spiBus->setFourWire();
-    this->spiBus->setEightBits();
+    SPI_STEP *step = &this->steps[this->transaction.stepCount++];
+
+    step->flags = flags;
+    step->count = count;
+    step->data = data;
+    step->delayUs = 0;
 }
 
-void EEPROM :: configureSpiBus16Bit( void )
+void EEPROM :: releaseAtEnd(void)
 {
-    // configure the shared bus
-    this->spiBus->setFourWire();
-    this->spiBus->setSixteenBits();
+    // release CS at the end and give it time to register high
+    SPI_STEP *last = &this->steps[this->transaction.stepCount - 1];
+    last->flags |= SPI_RELEASE;
+    last->delayUs = CS_RISE_TIME_US;
 }
 
-Uint16 EEPROM :: readStatusRegister(void)
+void EEPROM :: runTransaction(void)
 {
-    Uint16 command = 0b0000010100000000;
-
-    configureSpiBus8Bit();
+    releaseAtEnd();
 
-    CS_ASSERT;
-    this->spiBus->sendWord(command);
-    Uint16 status = this->spiBus->receiveWord();
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);
-
-    return status;
+    this->spiBus->transfer(&this->transaction);
+    this->transaction.stepCount = 0;
 }
 
-void EEPROM :: setWriteLatch(void)
+bool EEPROM :: submitTransaction(void)
 {
-    Uint16 command = 0b0000011000000000;
+    releaseAtEnd();
 
-    configureSpiBus8Bit();
+    // the steps stay in place until the bus is done with them; the next
+    // command clears them
+    return this->spiBus->submit(&this->transaction);
+}
 
-    CS_ASSERT;
-    this->spiBus->sendWord(command);
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);
+void EEPROM :: sendReadStatus(void)
+{
+    this->command[0] = 0b0000010100000000;
 
+    addStep(SPI_SEND | SPI_EIGHT_BITS, 1, &this->command[0]);
+    addStep(SPI_EIGHT_BITS, 1, &this->status);
 }
 
-void EEPROM :: waitForWriteCycle(void)
+void EEPROM :: sendWriteLatch(void)
 {
-    while( readStatusRegister() & 0b0000000000000001 );
+    // the latch only takes effect when CS goes high, so release after it
+    this->command[2] = 0b0000011000000000;
+
+    addStep(SPI_SEND | SPI_EIGHT_BITS, 1, &this->command[2]);
+    releaseAtEnd();
 }
 
 void EEPROM :: sendReadCommand(Uint16 blockNumber)
@@ -111,18 +129,16 @@ void EEPROM :: sendReadCommand(Uint16 blockNumber)
             ((address & 0b0000000100000000) << 3);  // bit 8 of address
 
     // send the command-address
-    configureSpiBus16Bit();
-    this->spiBus->sendWord(command);
+    this->command[0] = command;
+    addStep(SPI_SEND, 1, &this->command[0]);
 #endif
 
 #ifdef EEPROM_CHIP_AT25080B
-    // send the command
-    configureSpiBus8Bit();
-    this->spiBus->sendWord(command);
-
-    // send the address
-    configureSpiBus16Bit();
-    this->spiBus->sendWord(address);
+    // send the command, then the address
+    this->command[0] = command;
+    this->command[1] = address;
+    addStep(SPI_SEND | SPI_EIGHT_BITS, 1, &this->command[0]);
+    addStep(SPI_SEND, 1, &this->command[1]);
 #endif
 }
 
@@ -138,61 +154,89 @@ void EEPROM :: sendWriteCommand(Uint16 blockNumber)
             ((address & 0b0000000100000000) << 3);  // bit 8 of address
 
     // send the command-address
-    configureSpiBus16Bit();
-    this->spiBus->sendWord(command);
+    this->command[0] = command;
+    addStep(SPI_SEND, 1, &this->command[0]);
 #endif
 
 #ifdef EEPROM_CHIP_AT25080B
-    // send the command
-    configureSpiBus8Bit();
-    this->spiBus->sendWord(command);
-
-    // send the address
-    configureSpiBus16Bit();
-    this->spiBus->sendWord(address);
+    // send the command, then the address
+    this->command[0] = command;
+    this->command[1] = address;
+    addStep(SPI_SEND | SPI_EIGHT_BITS, 1, &this->command[0]);
+    addStep(SPI_SEND, 1, &this->command[1]);
 #endif
 }
 
 void EEPROM :: receivePage(Uint16 pageSize, Uint16 *buffer)
 {
-    configureSpiBus16Bit();
-
-    for( Uint16 i=0; i < pageSize; i++ ) {
-        buffer[i] = this->spiBus->receiveWord();
-    }
+    addStep(0, pageSize, buffer);
 }
 
 void EEPROM :: sendPage(Uint16 pageSize, Uint16 *buffer)
 {
-    configureSpiBus16Bit();
-
-    for( Uint16 i=0; i < pageSize; i++ ) {
-        this->spiBus->sendWord(buffer[i]);
-    }
+    addStep(SPI_SEND, pageSize, buffer);
 }
 
 bool EEPROM :: readPage(Uint16 pageNum, Uint16 *buffer)
 {
-    CS_ASSERT;
     sendReadCommand(pageNum);
     receivePage(EEPROM_PAGE_SIZE, buffer);
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);
+    runTransaction();
 
     return true;
 }
 
 bool EEPROM :: writePage(Uint16 pageNum, Uint16 *buffer)
 {
-    setWriteLatch();
+    if( this->writeState != EEPROM_IDLE || this->transaction.busy ) {
+        return false;
+    }
+
+    for( Uint16 i = 0; i < EEPROM_PAGE_SIZE; i++ ) {
+        this->writeBuffer[i] = buffer[i];
+    }
 
-    CS_ASSERT;
+    // latch, command and page go out as one transaction
+    this->transaction.stepCount = 0;
+    sendWriteLatch();
     sendWriteCommand(pageNum);
-    sendPage(EEPROM_PAGE_SIZE, buffer);
-    CS_RELEASE;
-    DELAY_US(CS_RISE_TIME_US);
+    sendPage(EEPROM_PAGE_SIZE, this->writeBuffer);
+    if( ! submitTransaction() ) {
+        this->transaction.stepCount = 0;
+        return false;
+    }
 
-    waitForWriteCycle();
+    this->writeState = EEPROM_WRITING;
+    return true;
+}
 
+bool EEPROM :: isWriting(void)
+{
+    if( this->writeState == EEPROM_IDLE ) {
+        return false;
+    }
+
+    // the last command is still on the bus
+    if( this->transaction.busy ) {
+        return true;
+    }
+
+    // the status read came back with the write-in-progress bit clear
+    if( this->writeState == EEPROM_POLLING && ! (this->status & 0b0000000000000001) ) {
+        this->transaction.stepCount = 0;
+        this->writeState = EEPROM_IDLE;
+        return false;
+    }
+
+    // the write went out, or the EEPROM was still busy; ask again.  If the
+    // bus queue is full, the next call tries again.
+    this->transaction.stepCount = 0;
+    sendReadStatus();
+    if( submitTransaction() ) {
+        this->writeState = EEPROM_POLLING;
+    }
+    else {
+        this->transaction.stepCount = 0;
+    }
     return true;
 }
@@ -43,22 +43,38 @@
 
 #define EEPROM_PAGE_SIZE 8 // 2-byte words
 
+// Background write states
+#define EEPROM_IDLE 0       // nothing in progress
+#define EEPROM_WRITING 1    // write latch, command and page on the bus
+#define EEPROM_POLLING 2    // status register read on the bus, checking WIP
+
 class EEPROM
 {
 private:
     // Shared SPI bus
     SPIBus *spiBus;
 
-    Uint16 readStatusRegister( void );
-    void setWriteLatch( void );
-    void waitForWriteCycle( void );
+    // transaction being built; every command fits in four steps
+    Uint16 command[3];
+    Uint16 status;
+    SPI_STEP steps[4];
+    SPI_TRANSACTION transaction;
+
+    // background write: state, and a copy of the page so the caller can keep
+    // changing its own
+    Uint16 writeState;
+    Uint16 writeBuffer[EEPROM_PAGE_SIZE];
+
+    void sendReadStatus( void );
+    void sendWriteLatch( void );
     void sendReadCommand(Uint16 blockNumber);
     void sendWriteCommand(Uint16 blockNumber);
     void receivePage(Uint16 numWords, Uint16 *buffer);
     void sendPage(Uint16 numWords, Uint16 *buffer);
-    void initSpi(void);
-    void configureSpiBus8Bit(void);
-    void configureSpiBus16Bit(void);
+    void addStep(Uint16 flags, Uint16 count, Uint16 *data);
+    void releaseAtEnd(void);
+    void runTransaction(void);
+    bool submitTransaction(void);
 
 public:
     EEPROM(SPIBus *spiBus);
@@ -66,8 +82,16 @@ public:
     // initialize hardware for operation
     void initHardware(void);
 
+    // read a page, waiting for the bus; for use at startup
     bool readPage(Uint16 pageNum, Uint16 *buffer);
+
+    // start writing a page in the background; false if a write is still in
+    // progress or the bus queue is full, so try again later
     bool writePage(Uint16 pageNum, Uint16 *buffer);
+
+    // move a background write along: true until the EEPROM has finished its
+    // internal write cycle.  Never waits; call it regularly.
+    bool isWriting(void);
 };
 
 
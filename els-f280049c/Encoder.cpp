@@ -28,17 +28,75 @@
 #include "Configuration.h"
 
 
+// Input qualification levels, weakest first: GPxQSEL mode (0 sync, 1 three
+// samples, 2 six samples) and QUALPRD, which samples every 2*QUALPRD SYSCLKs
+// (every SYSCLK for 0).  A pulse must outlast (samples-1) sampling periods to
+// get through.
+typedef struct QUALIFICATION
+{
+    Uint16 select;
+    Uint16 period;
+    Uint16 windowCycles;
+} QUALIFICATION;
+
+const QUALIFICATION QUALIFICATIONS[ENCODER_QUALIFICATION_LEVELS] =
+{
+ { 0, 0, 0 },
+ { 1, 0, 2 },
+ { 2, 0, 5 },
+ { 2, 1, 10 },
+ { 2, 2, 20 },
+ { 2, 5, 50 },
+ { 2, 10, 100 },
+ { 2, 25, 250 },
+ { 2, 50, 500 },
+};
+
+
 Encoder :: Encoder( void )
 {
     this->previous = 0;
     this->rpm = 0;
+
+    this->resolution = ENCODER_RESOLUTION;
+    this->acceleration = 0;
+
+    this->sampleSpacing = ENCODER_RESOLUTION / ENCODER_SPEED_SAMPLES;
+    this->speedSamples = 0;
+    this->minPeriod = 0xffff;
+    this->maxPeriod = 0;
+    this->speedValid = true;
+    this->speedVariation = 0;
+
+    this->qualification = 0;
+    this->glitches = 0;
+    this->calibrating = false;
+    this->calibrationRevs = 0;
+    this->calibrationCounts = 0;
+    this->calibratedResolution = 0;
+
+    this->phaseErrors = 0;
+    this->indexErrors = 0;
+    this->indexCount = 0;
+    this->previousIndex = 0;
+    this->previousIndexDirection = 0;
+    this->indexSeen = false;
+
+    this->wakeArmed = false;
+    this->wakeLatched = false;
+    this->wakeTime = 0;
+
+#ifdef USE_INDEX_CORRECTION
+    this->countCorrection = 0;
+    this->correctedCounts = 0;
+    this->indexFault = false;
+#endif // USE_INDEX_CORRECTION
 }
 
-void Encoder :: initHardware(void)
+void initEqep1Pins( void )
 {
     EALLOW;
 
-#ifdef ENCODER_USE_EQEP1
     GpioCtrlRegs.GPBPUD.bit.GPIO35 = 0;     // Enable pull-up on GPIO35 (EQEP1A)
     GpioCtrlRegs.GPBPUD.bit.GPIO37 = 0;     // Enable pull-up on GPIO371 (EQEP1B)
     GpioCtrlRegs.GPBPUD.bit.GPIO59 = 0;     // Enable pull-up on GPIO59 (EQEP1I)
@@ -53,8 +111,14 @@ void Encoder :: initHardware(void)
     GpioCtrlRegs.GPBGMUX1.bit.GPIO37 = 2;
     GpioCtrlRegs.GPBMUX2.bit.GPIO59 = 3;    // Configure GPIO59 as EQEP1I
     GpioCtrlRegs.GPBGMUX2.bit.GPIO59 = 2;
-#endif
-#ifdef ENCODER_USE_EQEP2
+
+    EDIS;
+}
+
+void initEqep2Pins( void )
+{
+    EALLOW;
+
     GpioCtrlRegs.GPAPUD.bit.GPIO14 = 0;     // Enable pull-up on GPIO14 (EQEP2A)
     GpioCtrlRegs.GPAPUD.bit.GPIO15 = 0;     // Enable pull-up on GPIO15 (EQEP2B)
     GpioCtrlRegs.GPAPUD.bit.GPIO26 = 0;     // Enable pull-up on GPIO26 (EQEP2I)
@@ -69,9 +133,78 @@ void Encoder :: initHardware(void)
     GpioCtrlRegs.GPAGMUX1.bit.GPIO15 = 2;
     GpioCtrlRegs.GPAMUX2.bit.GPIO26 = 2;    // Configure GPIO26 as EQEP2I
     GpioCtrlRegs.GPAGMUX2.bit.GPIO26 = 0;
-#endif
 
     EDIS;
+}
+
+void qualifyEqep1Pins( Uint16 select, Uint16 period )
+{
+    EALLOW;
+
+    GpioCtrlRegs.GPBCTRL.bit.QUALPRD0 = period; // GPIO32-39, including EQEP1A/B
+    GpioCtrlRegs.GPBCTRL.bit.QUALPRD3 = period; // GPIO56-63, including EQEP1I
+
+    GpioCtrlRegs.GPBQSEL1.bit.GPIO35 = select;
+    GpioCtrlRegs.GPBQSEL1.bit.GPIO37 = select;
+    GpioCtrlRegs.GPBQSEL2.bit.GPIO59 = select;
+
+    EDIS;
+}
+
+void qualifyEqep2Pins( Uint16 select, Uint16 period )
+{
+    EALLOW;
+
+    GpioCtrlRegs.GPACTRL.bit.QUALPRD1 = period; // GPIO8-15, including EQEP2A/B
+    GpioCtrlRegs.GPACTRL.bit.QUALPRD3 = period; // GPIO24-31, including EQEP2I
+
+    GpioCtrlRegs.GPAQSEL1.bit.GPIO14 = select;
+    GpioCtrlRegs.GPAQSEL1.bit.GPIO15 = select;
+    GpioCtrlRegs.GPAQSEL2.bit.GPIO26 = select;
+
+    EDIS;
+}
+
+void Encoder :: setQualification(Uint16 level)
+{
+    if( level >= ENCODER_QUALIFICATION_LEVELS ) {
+        level = ENCODER_QUALIFICATION_LEVELS - 1;
+    }
+    this->qualification = level;
+    qualifyEncoderPins(QUALIFICATIONS[level].select, QUALIFICATIONS[level].period);
+}
+
+Uint16 Encoder :: strongestQualification(Uint16 rpm)
+{
+    if( rpm == 0 ) {
+        return ENCODER_QUALIFICATION_LEVELS - 1;
+    }
+
+    // the shortest time between edges is one count; allow the filter half of
+    // it, since the qualifier delays A and B by different amounts.  A geared
+    // encoder turns ENCODER_GEAR_NUMERATOR/ENCODER_GEAR_DENOMINATOR as fast as
+    // the spindle
+    Uint64 countCycles = (Uint64)CPU_CLOCK_HZ * 60 * ENCODER_GEAR_DENOMINATOR
+            / ((Uint64)rpm * ENCODER_GEAR_NUMERATOR * this->resolution);
+
+    Uint16 level = 0;
+    while( level < ENCODER_QUALIFICATION_LEVELS - 1 && QUALIFICATIONS[level + 1].windowCycles * 2 <= countCycles ) {
+        level++;
+    }
+    return level;
+}
+
+void Encoder :: countGlitches(bool enable)
+{
+    if( enable ) {
+        this->glitches = 0;
+    }
+    ENCODER_REGS.QEINT.bit.QDC = enable;
+}
+
+void Encoder :: initHardware(void)
+{
+    initEncoderPins();
 
     ENCODER_REGS.QDECCTL.bit.QSRC = 0;         // QEP quadrature count mode
     ENCODER_REGS.QDECCTL.bit.IGATE = 1;        // gate the index pin
@@ -86,13 +219,238 @@ void Encoder :: initHardware(void)
     ENCODER_REGS.QEPCTL.bit.UTE=1;             // Unit Timeout Enable
     ENCODER_REGS.QEPCTL.bit.QCLM=1;            // Latch on unit time out
 
+    ENCODER_REGS.QCAPCTL.bit.CEN=0;            // disable capture while configuring
+    ENCODER_REGS.QCAPCTL.bit.CCPS=_ENCODER_CAPTURE_PRESCALE; // capture timer clock = SYSCLK/128
+    ENCODER_REGS.QCAPCTL.bit.UPPS=_ENCODER_CAPTURE_EVENT_PRESCALE; // unit position event every 4 counts
+    ENCODER_REGS.QCAPCTL.bit.CEN=1;            // enable capture timer
+
+    // The eQEP's own position counter error check (PCE) only works when the
+    // count resets on index, which would break the free-running count that
+    // Core depends on, so index pulses are checked in software instead
+    ENCODER_REGS.QEPCTL.bit.IEL=1;             // latch position on the rising edge of index
+    // speed samples are taken at position compare events, rearmed each time
+    ENCODER_REGS.QPOSCTL.bit.PCSHDW=0;         // load compare value immediately
+    ENCODER_REGS.QPOSCMP = this->sampleSpacing; // first sample
+    ENCODER_REGS.QPOSCTL.bit.PCE=1;            // enable position compare
+
+    ENCODER_REGS.QCLR.all = 0xffff;            // start with no stale flags
+    ENCODER_REGS.QEINT.bit.QPE=1;              // interrupt on quadrature phase error
+    ENCODER_REGS.QEINT.bit.IEL=1;              // interrupt on index latch
+    ENCODER_REGS.QEINT.bit.PCM=1;              // interrupt on position compare
+
     ENCODER_REGS.QEPCTL.bit.QPEN=1;            // QEP enable
 
+    // route A and B to the external interrupts for the idle wake, disabled
+    // until armed
+    GPIO_SetupXINT1Gpio(ENCODER_A_GPIO);
+    GPIO_SetupXINT2Gpio(ENCODER_B_GPIO);
+    XintRegs.XINT1CR.bit.POLARITY = 3;         // interrupt on both edges
+    XintRegs.XINT2CR.bit.POLARITY = 3;
+    XintRegs.XINT1CR.bit.ENABLE = 0;
+    XintRegs.XINT2CR.bit.ENABLE = 0;
+}
+
+void Encoder :: armWake(void)
+{
+    // anything latched earlier is stale
+    this->wakeLatched = false;
+    this->wakeArmed = true;
+    XintRegs.XINT1CR.bit.ENABLE = 1;
+    XintRegs.XINT2CR.bit.ENABLE = 1;
+}
+
+void Encoder :: wakeISR(void)
+{
+    // both inputs can have an edge pending; only the first one counts
+    if( this->wakeArmed ) {
+        this->wakeTime = CpuTimer2Regs.TIM.all;
+        this->wakeLatched = true;
+        this->wakeArmed = false;
+        XintRegs.XINT1CR.bit.ENABLE = 0;
+        XintRegs.XINT2CR.bit.ENABLE = 0;
+    }
+}
+
+Uint16 Encoder :: periodRPM(void)
+{
+    union QEPSTS_REG status;
+    status.all = ENCODER_REGS.QEPSTS.all;
+
+    // the period is meaningless if the timer overflowed (too slow to measure)
+    // or the direction changed partway through
+    if( status.bit.COEF || status.bit.CDEF )
+    {
+        union QEPSTS_REG clear;
+        clear.all = 0;
+        clear.bit.COEF = 1;
+        clear.bit.CDEF = 1;
+        ENCODER_REGS.QEPSTS.all = clear.all;
+        return 0;
+    }
+
+    // if the spindle is slowing down, the time since the last cycle is already
+    // longer than the last full period; use it so the reading falls promptly
+    Uint32 period = ENCODER_REGS.QCPRDLAT;
+    Uint32 elapsed = ENCODER_REGS.QCTMR;
+    if( elapsed > period ) {
+        period = elapsed;
+    }
+
+    if( period == 0 ) {
+        return 0;
+    }
+    return _ENCODER_PERIOD_RPM / (this->resolution * period);
+}
+
+void Encoder :: checkIndex(void)
+{
+    Uint32 index = ENCODER_REGS.QPOSILAT;
+    Uint16 direction = ENCODER_REGS.QEPSTS.bit.QDLF;
+
+    this->indexCount++;
+
+    // only compare consecutive pulses passed in the same direction; on a
+    // reversal the index edge is seen from the other side
+    if( this->indexSeen && direction == this->previousIndexDirection )
+    {
+        // the count wraps at 24 bits, so sign-extend the difference
+        int32 distance = ((int32)((index - this->previousIndex) << 8)) >> 8;
+
+        if( this->calibrating ) {
+            // the resolution is what's being measured, so don't check against it
+            calibrateIndex(distance);
+        }
+        else {
+            // the index is one pulse per revolution no matter what; any difference
+            // is counts missed (positive) or gained (negative) in this direction
+            int32 expected = (distance < 0) ? -(int32)this->resolution : this->resolution;
+            int32 error = expected - distance;
+            int32 magnitude = (error < 0) ? -error : error;
+
+            if( magnitude > ENCODER_INDEX_TOLERANCE ) {
+                this->indexErrors++;
+
+#ifdef USE_INDEX_CORRECTION
+                if( magnitude > ENCODER_INDEX_ALARM_COUNTS ) {
+                    this->indexFault = true;
+                }
+                else {
+                    this->countCorrection += error;
+                    this->correctedCounts += magnitude;
+                }
+#endif // USE_INDEX_CORRECTION
+            }
+        }
+    }
+
+    this->previousIndex = index;
+    this->previousIndexDirection = direction;
+    this->indexSeen = true;
+}
+
+void Encoder :: startCalibration(void)
+{
+    this->calibrating = false;
+    this->calibrationRevs = 0;
+    this->calibrationCounts = 0;
+    this->calibratedResolution = 0;
+    this->calibrating = true;
+}
+
+void Encoder :: calibrateIndex(int32 distance)
+{
+    this->calibrationCounts += (distance < 0) ? -distance : distance;
+    this->calibrationRevs++;
+
+    if( this->calibrationRevs >= ENCODER_CALIBRATION_REVS )
+    {
+        // average, rounded to the nearest whole quadrature cycle
+        Uint32 counts = (this->calibrationCounts + ENCODER_CALIBRATION_REVS * 2) / (ENCODER_CALIBRATION_REVS * 4) * 4;
+
+        if( counts >= _ENCODER_MIN_RESOLUTION && counts <= _ENCODER_MAX_RESOLUTION ) {
+            this->calibratedResolution = counts;
+        }
+        else {
+            this->calibratedResolution = 0;
+        }
+
+        // publish the result before the flag, since the UI polls the flag
+        this->calibrating = false;
+    }
+}
+
+void Encoder :: armSpeedSample(Uint32 position)
+{
+    // next sample a fixed distance ahead in the direction of travel
+    Uint32 next = ENCODER_REGS.QEPSTS.bit.QDF ? position + sampleSpacing : position - sampleSpacing;
+    ENCODER_REGS.QPOSCMP = next & _ENCODER_MAX_COUNT;
+}
+
+void Encoder :: sampleSpeed(void)
+{
+    union QEPSTS_REG status;
+    status.all = ENCODER_REGS.QEPSTS.all;
+    Uint16 period = ENCODER_REGS.QCPRD;
+
+    // an overflowed or reversed period spoils the whole revolution; the flags
+    // themselves belong to periodRPM(), which clears them
+    if( status.bit.COEF || status.bit.CDEF || period == 0 ) {
+        this->speedValid = false;
+    }
+    else {
+        if( period < this->minPeriod ) this->minPeriod = period;
+        if( period > this->maxPeriod ) this->maxPeriod = period;
+    }
+
+    if( ++this->speedSamples >= ENCODER_SPEED_SAMPLES ) {
+        if( this->speedValid ) {
+            this->speedVariation = _ENCODER_PERIOD_RPM / ((Uint32)this->resolution * this->minPeriod)
+                - _ENCODER_PERIOD_RPM / ((Uint32)this->resolution * this->maxPeriod);
+        }
+        this->speedSamples = 0;
+        this->minPeriod = 0xffff;
+        this->maxPeriod = 0;
+        this->speedValid = true;
+    }
+
+    armSpeedSample(ENCODER_REGS.QPOSCNT);
+}
+
+void Encoder :: ISR(void)
+{
+    union QFLG_REG flags;
+    flags.all = ENCODER_REGS.QFLG.all;
+
+    if( flags.bit.PHE ) {
+        this->phaseErrors++;
+    }
+    if( flags.bit.IEL ) {
+        checkIndex();
+
+        // a reversal leaves the compare point behind; pick it up again here
+        armSpeedSample(ENCODER_REGS.QPOSILAT);
+    }
+    if( flags.bit.PCM ) {
+        sampleSpeed();
+    }
+    if( flags.bit.QDC ) {
+        this->glitches++;
+    }
+
+    // clear only what we handle; the unit timeout flag is polled by getRPM()
+    union QCLR_REG clear;
+    clear.all = 0;
+    clear.bit.PHE = flags.bit.PHE;
+    clear.bit.IEL = flags.bit.IEL;
+    clear.bit.PCM = flags.bit.PCM;
+    clear.bit.QDC = flags.bit.QDC;
+    clear.bit.INT = 1;
+    ENCODER_REGS.QCLR.all = clear.all;
 }
 
 Uint16 Encoder :: getRPM(void)
 {
-    if(ENCODER_REGS.QFLG.bit.UTO==1)       // If unit timeout (one 10Hz period)
+    if(ENCODER_REGS.QFLG.bit.UTO==1)       // If unit timeout (one window)
     {
         Uint32 current = ENCODER_REGS.QPOSLAT;
         Uint32 count = (current > previous) ? current - previous : previous - current;
@@ -102,7 +460,32 @@ Uint16 Encoder :: getRPM(void)
             count = _ENCODER_MAX_COUNT - count; // just subtract from max value
         }
 
-        rpm = count * 60 * RPM_CALC_RATE_HZ / ENCODER_RESOLUTION;
+        Uint32 windowRpm = count * 60 * RPM_CALC_RATE_HZ / this->resolution;
+        Uint32 encoderRpm;
+
+        if( count >= _ENCODER_WINDOW_COUNTS ) {
+            // fast: plenty of counts in the window
+            encoderRpm = windowRpm;
+        }
+        else if( count <= _ENCODER_PERIOD_COUNTS ) {
+            // slow: time the counts instead
+            encoderRpm = periodRPM();
+        }
+        else {
+            // in between: blend linearly so there is no step at either threshold
+            Uint32 weight = count - _ENCODER_PERIOD_COUNTS;
+            Uint32 span = _ENCODER_WINDOW_COUNTS - _ENCODER_PERIOD_COUNTS;
+            encoderRpm = (windowRpm * weight + (Uint32)periodRPM() * (span - weight)) / span;
+        }
+
+        // report spindle speed, allowing for a geared encoder
+        Uint16 newRpm = encoderRpm * ENCODER_GEAR_DENOMINATOR / ENCODER_GEAR_NUMERATOR;
+
+        // the speed only ever reads positive, so this is acceleration away from
+        // a stop, whichever way the spindle turns
+        int32 change = ((int32)newRpm - (int32)rpm) * RPM_CALC_RATE_HZ;
+        acceleration += (change - acceleration) / _ENCODER_ACCELERATION_FILTER;
+        rpm = newRpm;
 
         previous = current;
         ENCODER_REGS.QCLR.bit.UTO=1;       // Clear interrupt flag
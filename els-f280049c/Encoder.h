@@ -30,15 +30,72 @@
 #include "F28x_Project.h"
 #include "Configuration.h"
 
+// The spindle encoder uses one eQEP; the other is available for an auxiliary
+// quadrature input, like a leadscrew encoder
 #ifdef ENCODER_USE_EQEP1
 #define ENCODER_REGS EQep1Regs
+#define AUX_ENCODER_REGS EQep2Regs
+#define initEncoderPins initEqep1Pins
+#define initAuxEncoderPins initEqep2Pins
+#define qualifyEncoderPins qualifyEqep1Pins
+#define ENCODER_PIE_VECTOR EQEP1_INT
+#define ENCODER_PIE_ENABLE PieCtrlRegs.PIEIER5.bit.INTx1
+#define ENCODER_A_GPIO 35
+#define ENCODER_B_GPIO 37
 #endif
 #ifdef ENCODER_USE_EQEP2
 #define ENCODER_REGS EQep2Regs
+#define AUX_ENCODER_REGS EQep1Regs
+#define initEncoderPins initEqep2Pins
+#define initAuxEncoderPins initEqep1Pins
+#define qualifyEncoderPins qualifyEqep2Pins
+#define ENCODER_PIE_VECTOR EQEP2_INT
+#define ENCODER_PIE_ENABLE PieCtrlRegs.PIEIER5.bit.INTx2
+#define ENCODER_A_GPIO 14
+#define ENCODER_B_GPIO 15
 #endif
 
 #define _ENCODER_MAX_COUNT 0x00ffffff
 
+// eQEP capture timer prescaler (SYSCLK/128) and resulting tick in microseconds
+#define _ENCODER_CAPTURE_PRESCALE 7
+#define _ENCODER_CAPTURE_DIVISOR 128
+
+// The capture unit times one full quadrature cycle (4 counts), which cancels
+// any A/B phase imbalance in the encoder
+#define _ENCODER_CAPTURE_EVENT_PRESCALE 2
+#define _ENCODER_CAPTURE_COUNTS 4
+
+// RPM measurement: below _ENCODER_PERIOD_COUNTS counts per window the capture
+// period is used, above _ENCODER_WINDOW_COUNTS the count over the window is
+// used, and in between the two are blended so the reading doesn't jump.  The
+// two methods have the same resolution at about 56 counts per 10ms window.
+#define _ENCODER_PERIOD_COUNTS 32
+#define _ENCODER_WINDOW_COUNTS 128
+
+// RPM times capture period (in timer ticks) times ENCODER_RESOLUTION
+#define _ENCODER_PERIOD_RPM ((Uint32)CPU_CLOCK_HZ / _ENCODER_CAPTURE_DIVISOR * _ENCODER_CAPTURE_COUNTS * 60)
+
+// Acceleration is smoothed over about this many RPM windows
+#define _ENCODER_ACCELERATION_FILTER 4
+
+// Number of input qualification levels, from none (0) to the strongest
+#define ENCODER_QUALIFICATION_LEVELS 9
+
+// Plausible limits for a measured resolution: whole quadrature cycles only
+#define _ENCODER_MIN_RESOLUTION 100
+#define _ENCODER_MAX_RESOLUTION 10000
+
+
+// Pin setup for the two eQEP peripherals
+void initEqep1Pins( void );
+void initEqep2Pins( void );
+
+// Input qualification for the two eQEP peripherals: GPxQSEL mode and sampling
+// period (QUALPRD), which is shared with the other pins in the same bank of 8
+void qualifyEqep1Pins( Uint16 select, Uint16 period );
+void qualifyEqep2Pins( Uint16 select, Uint16 period );
+
 
 class Encoder
 {
@@ -46,6 +103,61 @@ private:
     Uint32 previous;
     Uint16 rpm;
 
+    // counts per encoder revolution in use
+    Uint16 resolution;
+
+    // spindle acceleration in RPM per second, updated with the RPM
+    int32 acceleration;
+
+    // speed samples over the current revolution, taken from the capture
+    // period at evenly spaced position compare events
+    Uint16 sampleSpacing;
+    Uint16 speedSamples;
+    Uint16 minPeriod;
+    Uint16 maxPeriod;
+    bool speedValid;
+    Uint16 speedVariation;
+
+    void armSpeedSample(Uint32 position);
+    void sampleSpeed(void);
+
+    // input qualification level in use, and direction changes counted while
+    // looking for glitches
+    Uint16 qualification;
+    Uint32 glitches;
+
+    // resolution measurement from the index pulse
+    bool calibrating;
+    Uint16 calibrationRevs;
+    Uint32 calibrationCounts;
+    Uint16 calibratedResolution;
+
+    Uint16 periodRPM(void);
+
+    // signal integrity, updated from the eQEP interrupt
+    Uint32 phaseErrors;
+    Uint32 indexErrors;
+    Uint32 indexCount;
+    Uint32 previousIndex;
+    Uint16 previousIndexDirection;
+    bool indexSeen;
+
+#ifdef USE_INDEX_CORRECTION
+    // total counts to add to the raw position, and how many have been fixed
+    int32 countCorrection;
+    Uint32 correctedCounts;
+    bool indexFault;
+#endif // USE_INDEX_CORRECTION
+
+    void checkIndex(void);
+    void calibrateIndex(int32 distance);
+
+    // wake on the first edge: armed while the stepper interrupt is idle, and
+    // the timer 2 count latched when the edge arrived
+    bool wakeArmed;
+    bool wakeLatched;
+    Uint32 wakeTime;
+
 public:
     Encoder( void );
     void initHardware( void );
@@ -53,19 +165,186 @@ public:
     Uint16 getRPM( void );
     Uint32 getPosition( void );
     Uint32 getMaxCount( void );
+
+    // counts per encoder revolution; defaults to ENCODER_RESOLUTION
+    Uint16 getResolution( void );
+    void setResolution( Uint16 resolution );
+
+    // input qualification level, 0 (none) to ENCODER_QUALIFICATION_LEVELS-1
+    Uint16 getQualification( void );
+    void setQualification( Uint16 level );
+
+    // the strongest qualification that still passes every edge at rpm
+    Uint16 strongestQualification( Uint16 rpm );
+
+    // count direction changes as glitches; they don't happen in normal running
+    // and a noisy edge makes two of them
+    void countGlitches( bool enable );
+    Uint32 getGlitches( void );
+
+    // spindle acceleration, in RPM per second
+    int32 getAcceleration( void );
+
+    // difference between the fastest and slowest spindle speed seen over the
+    // last revolution, in RPM
+    Uint16 getSpeedVariation( void );
+
+    // measure the counts per revolution from the index pulse over the next
+    // ENCODER_CALIBRATION_REVS revolutions; the result is 0 if the measured
+    // value isn't a plausible encoder resolution
+    void startCalibration( void );
+    bool isCalibrating( void );
+    Uint16 getCalibrationRevs( void );
+    Uint16 getCalibratedResolution( void );
+
+    // signal integrity counters
+    Uint32 getPhaseErrors( void );
+    Uint32 getIndexErrors( void );
+    Uint32 getIndexCount( void );
+    Uint32 getErrorCount( void );
+
+#ifdef USE_INDEX_CORRECTION
+    // counts to add to getPosition() to make up for index errors
+    int32 getCountCorrection( void );
+    Uint32 getCorrectedCounts( void );
+
+    // an index error too large to correct; latched until cleared
+    bool isIndexFault( void );
+    void clearIndexFault( void );
+#endif // USE_INDEX_CORRECTION
+
+    // eQEP interrupt: phase errors, index pulses, speed samples and glitches
+    void ISR( void );
+
+    // Edges on A and B also reach XINT1 and XINT2 through the input X-BAR.
+    // While armed, the first one latches the time and disarms both, so the
+    // stepper interrupt can be brought out of its idle poll right away.
+    void armWake( void );
+    void wakeISR( void );
+
+    // timer 2 count when the first edge arrived; true only once per wake
+    bool takeWakeTime( Uint32 *timer );
 };
 
 
+// called from the stepper interrupt; see Core::ISR
+#pragma FUNC_ALWAYS_INLINE
 inline Uint32 Encoder :: getPosition(void)
 {
     return ENCODER_REGS.QPOSCNT;
 }
 
+#pragma FUNC_ALWAYS_INLINE
 inline Uint32 Encoder :: getMaxCount(void)
 {
     return _ENCODER_MAX_COUNT;
 }
 
+inline Uint16 Encoder :: getResolution(void)
+{
+    return this->resolution;
+}
+
+inline void Encoder :: setResolution(Uint16 resolution)
+{
+    this->resolution = resolution;
+    this->sampleSpacing = resolution / ENCODER_SPEED_SAMPLES;
+}
+
+inline Uint16 Encoder :: getQualification(void)
+{
+    return this->qualification;
+}
+
+inline Uint32 Encoder :: getGlitches(void)
+{
+    return this->glitches;
+}
+
+inline int32 Encoder :: getAcceleration(void)
+{
+    return this->acceleration;
+}
+
+inline Uint16 Encoder :: getSpeedVariation(void)
+{
+    // allow for a geared encoder, like the RPM
+    return (Uint32)this->speedVariation * ENCODER_GEAR_DENOMINATOR / ENCODER_GEAR_NUMERATOR;
+}
+
+inline bool Encoder :: isCalibrating(void)
+{
+    return this->calibrating;
+}
+
+inline Uint16 Encoder :: getCalibrationRevs(void)
+{
+    return this->calibrationRevs;
+}
+
+inline Uint16 Encoder :: getCalibratedResolution(void)
+{
+    return this->calibratedResolution;
+}
+
+
+inline Uint32 Encoder :: getPhaseErrors(void)
+{
+    return this->phaseErrors;
+}
+
+inline Uint32 Encoder :: getIndexErrors(void)
+{
+    return this->indexErrors;
+}
+
+inline Uint32 Encoder :: getIndexCount(void)
+{
+    return this->indexCount;
+}
+
+inline Uint32 Encoder :: getErrorCount(void)
+{
+    return this->phaseErrors + this->indexErrors;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Encoder :: takeWakeTime(Uint32 *timer)
+{
+    if( ! this->wakeLatched ) {
+        return false;
+    }
+    *timer = this->wakeTime;
+    this->wakeLatched = false;
+    return true;
+}
+
+#ifdef USE_INDEX_CORRECTION
+#pragma FUNC_ALWAYS_INLINE
+inline int32 Encoder :: getCountCorrection(void)
+{
+    return this->countCorrection;
+}
+
+inline Uint32 Encoder :: getCorrectedCounts(void)
+{
+    return this->correctedCounts;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool Encoder :: isIndexFault(void)
+{
+    return this->indexFault;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void Encoder :: clearIndexFault(void)
+{
+    // start checking afresh from the next index pulse
+    this->indexSeen = false;
+    this->indexFault = false;
+}
+#endif // USE_INDEX_CORRECTION
 
 
 #endif // __ENCODER_H
@@ -0,0 +1,59 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef __HANDWHEEL_H
+#define __HANDWHEEL_H
+
+#include "F28x_Project.h"
+#include "Configuration.h"
+#include "Encoder.h"
+
+
+//
+// Optional manual pulse generator (MPG) handwheel, read by the eQEP that is not
+// used by the spindle encoder.  Core turns its detents into leadscrew steps
+// when jogging is allowed.
+//
+class Handwheel
+{
+public:
+    Handwheel( void );
+    void initHardware( void );
+
+    // raw count, wraps at 32 bits
+    Uint32 getPosition( void );
+};
+
+
+// called from the stepper interrupt; see Core::ISR
+#pragma FUNC_ALWAYS_INLINE
+inline Uint32 Handwheel :: getPosition(void)
+{
+    return AUX_ENCODER_REGS.QPOSCNT;
+}
+
+
+#endif // __HANDWHEEL_H
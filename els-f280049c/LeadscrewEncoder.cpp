@@ -0,0 +1,49 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "LeadscrewEncoder.h"
+
+
+LeadscrewEncoder :: LeadscrewEncoder( void )
+{
+}
+
+void LeadscrewEncoder :: initHardware(void)
+{
+    initAuxEncoderPins();
+
+    AUX_ENCODER_REGS.QDECCTL.bit.QSRC = 0;         // QEP quadrature count mode
+    AUX_ENCODER_REGS.QDECCTL.bit.QAP = 1;          // invert A input
+    AUX_ENCODER_REGS.QDECCTL.bit.QBP = 1;          // invert B input
+#ifdef LEADSCREW_ENCODER_REVERSE
+    AUX_ENCODER_REGS.QDECCTL.bit.SWAP = 1;         // swap A and B to count the other way
+#endif
+    AUX_ENCODER_REGS.QEPCTL.bit.FREE_SOFT = 2;     // unaffected by emulation suspend
+    AUX_ENCODER_REGS.QEPCTL.bit.PCRM = 1;          // position count reset on maximum position
+    AUX_ENCODER_REGS.QPOSMAX = 0xffffffff;         // use the full 32-bit range
+
+    AUX_ENCODER_REGS.QEPCTL.bit.QPEN=1;            // QEP enable
+}
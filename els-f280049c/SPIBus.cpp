@@ -6,15 +6,35 @@
  */
 
 #include "SPIBus.h"
+
+
+// DMA channels: 5 feeds the transmit FIFO, 6 drains the receive FIFO
+#define DMA_TX DmaRegs.CH5
+#define DMA_RX DmaRegs.CH6
+
+// Word clocked out while a DMA step receives, and sink for the words clocked
+// in while one sends; both in GSRAM where the DMA can reach them
+#pragma DATA_SECTION("ramgs0")
+static Uint16 dmaFill;
+#pragma DATA_SECTION("ramgs0")
+static Uint16 dmaSink;
 #include "F28x_Project.h"
 
-// wait for the current serial shift operation to complete
-#define WAIT_FOR_SERIAL while(SpibRegs.SPISTS.bit.INT_FLAG !=1) {}
 
 
 SPIBus :: SPIBus( void )
 {
-    mask = 0xffff;
+    this->queueCount = 0;
+    this->device = NULL;
+    this->sixteenBits = false;
+
+    this->active = NULL;
+    this->stepIndex = 0;
+    this->wordIndex = 0;
+    this->chunk = 0;
+    this->selected = false;
+
+    mask = 0x00ff;
 }
 
 void SPIBus :: initHardware(void)
@@ -26,14 +46,56 @@ void SPIBus :: initHardware(void)
 
     // Set up SPI B
     SpibRegs.SPICCR.bit.SPISWRESET = 0; // Enter RESET state
-    setEightBits();
+    SpibRegs.SPICCR.bit.SPICHAR = 0x7; // 8 bits
     SpibRegs.SPICCR.bit.CLKPOLARITY = 1; // data latched on rising edge
     SpibRegs.SPICTL.bit.CLK_PHASE = 0; // normal clocking scheme
     SpibRegs.SPICTL.bit.MASTER_SLAVE = 1; // master
+    SpibRegs.SPICTL.bit.SPIINTENA = 1; // interrupt from the receive FIFO
     SpibRegs.SPIBRR.bit.SPI_BIT_RATE = 127; // SPI bit rate = LPSCLK/128 ~ 98Kbps
-    setThreeWire();
+    SpibRegs.SPIPRI.bit.TRIWIRE = 1; // 3-wire mode
+
+    // FIFOs on; the receive FIFO level is set for each chunk of words
+    SpibRegs.SPIFFTX.all = 0;
+    SpibRegs.SPIFFTX.bit.SPIRST = 1;
+    SpibRegs.SPIFFTX.bit.SPIFFENA = 1;
+    SpibRegs.SPIFFTX.bit.TXFIFO = 1;
+    SpibRegs.SPIFFTX.bit.TXFFIL = 0;        // DMA trigger: each time the FIFO empties
+    SpibRegs.SPIFFTX.bit.TXFFIENA = 1;      // not enabled in the PIE; only the DMA uses it
+    SpibRegs.SPIFFRX.all = 0;
+    SpibRegs.SPIFFRX.bit.RXFFOVFCLR = 1;
+    SpibRegs.SPIFFRX.bit.RXFFINTCLR = 1;
+    SpibRegs.SPIFFRX.bit.RXFIFORESET = 1;
+    SpibRegs.SPIFFRX.bit.RXFFIL = 1;
+    SpibRegs.SPIFFRX.bit.RXFFIENA = 1;
+    SpibRegs.SPIFFCT.all = 0;
+
     SpibRegs.SPICCR.bit.SPISWRESET = 1; // clear reset state; ready to transmit
 
+    // DMA moves one word per trigger; only the receive channel interrupts,
+    // since its last word marks the end of the step on the wire
+    DMAInitialize();
+    dmaFill = 0;
+    DMACH5BurstConfig(0, 0, 0);
+    DMACH5WrapConfig(0xffff, 0, 0xffff, 0);
+    DMACH5ModeConfig(DMA_SPIBTX, PERINT_ENABLE, ONESHOT_DISABLE, CONT_DISABLE,
+                     SYNC_DISABLE, SYNC_SRC, OVRFLOW_DISABLE, SIXTEEN_BIT,
+                     CHINT_END, CHINT_DISABLE);
+    DMACH6BurstConfig(0, 0, 0);
+    DMACH6WrapConfig(0xffff, 0, 0xffff, 0);
+    DMACH6ModeConfig(DMA_SPIBRX, PERINT_ENABLE, ONESHOT_DISABLE, CONT_DISABLE,
+                     SYNC_DISABLE, SYNC_SRC, OVRFLOW_DISABLE, SIXTEEN_BIT,
+                     CHINT_END, CHINT_ENABLE);
+
+    // pauses between steps end at a deadline on CPU timer 2, which the
+    // scheduler runs free at SYSCLK
+
+    // CPU timer 1 is armed for each pause and wakes the bus when it is over
+    CpuTimer1Regs.TCR.bit.TSS = 1;
+    CpuTimer1Regs.TPR.all = 0;
+    CpuTimer1Regs.TPRH.all = 0;
+    CpuTimer1Regs.TCR.bit.TIF = 1;
+    CpuTimer1Regs.TCR.bit.TIE = 1;
+
     EALLOW;
 
     // Set up muxing for SPIB pins
@@ -47,43 +109,250 @@ void SPIBus :: initHardware(void)
     EDIS;
 }
 
-void SPIBus :: setThreeWire( void )
+bool SPIBus :: submit(SPI_TRANSACTION *transaction)
 {
-    SpibRegs.SPIPRI.bit.TRIWIRE = 1; // 3-wire mode
+    bool queued = false;
+
+    // keep the SPI, DMA and timer interrupts out while the queue changes
+    IER &= ~(M_INT6 | M_INT7 | M_INT13);
+
+    if( this->queueCount < SPI_QUEUE_LENGTH ) {
+        transaction->busy = true;
+        this->queue[this->queueCount++] = transaction;
+        queued = true;
+
+        if( this->active == NULL ) {
+            startNext();
+        }
+    }
+
+    IER |= (M_INT6 | M_INT7 | M_INT13);
+
+    return queued;
 }
 
-void SPIBus :: setFourWire( void )
+void SPIBus :: transfer(SPI_TRANSACTION *transaction)
 {
-    SpibRegs.SPIPRI.bit.TRIWIRE = 0; // Normal (4-wire) mode
+    while( ! submit(transaction) ) {}
+    while( transaction->busy ) {}
 }
 
-void SPIBus :: setEightBits( void )
+void SPIBus :: startNext(void)
 {
-    SpibRegs.SPICCR.bit.SPICHAR = 0x7; // 8 bits
-    mask = 0x00ff;                     // set the mask to 8 bits
+    if( this->queueCount == 0 ) {
+        this->active = NULL;
+        return;
+    }
+
+    // highest priority first; oldest first among equals
+    Uint16 next = 0;
+    for( Uint16 i = 1; i < this->queueCount; i++ ) {
+        if( this->queue[i]->device->priority > this->queue[next]->device->priority ) {
+            next = i;
+        }
+    }
+    this->active = this->queue[next];
+    this->queueCount--;
+    for( Uint16 i = next; i < this->queueCount; i++ ) {
+        this->queue[i] = this->queue[i + 1];
+    }
+
+    if( this->active->device != this->device ) {
+        configure(this->active->device);
+    }
+
+    this->stepIndex = 0;
+    startStep();
+}
+
+void SPIBus :: configure(const SPI_DEVICE *device)
+{
+    SpibRegs.SPIPRI.bit.TRIWIRE = (device->flags & SPI_THREE_WIRE) ? 1 : 0;
+    SpibRegs.SPIBRR.bit.SPI_BIT_RATE = device->bitRate;
+
+    this->device = device;
 }
 
-void SPIBus :: setSixteenBits( void )
+void SPIBus :: startStep(void)
 {
-    SpibRegs.SPICCR.bit.SPICHAR = 0xF; // 16 bits
-    mask = 0xffff;                     // set the mask to 16 bits
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    // word size only changes if this step differs from the last
+    bool sixteenBits = (this->device->flags & SPI_SIXTEEN_BITS) != 0;
+    if( step->flags & SPI_SIXTEEN_BITS ) {
+        sixteenBits = true;
+    }
+    if( step->flags & SPI_EIGHT_BITS ) {
+        sixteenBits = false;
+    }
+    if( sixteenBits != this->sixteenBits ) {
+        SpibRegs.SPICCR.bit.SPICHAR = sixteenBits ? 0xF : 0x7;
+        this->mask = sixteenBits ? 0xffff : 0x00ff;
+        this->sixteenBits = sixteenBits;
+    }
+    SpibRegs.SPICTL.bit.TALK = (step->flags & SPI_SEND) ? 1 : 0;
+
+    if( ! this->selected ) {
+        GpioDataRegs.GPBCLEAR.all = this->device->chipSelect;
+        this->selected = true;
+    }
+
+    this->wordIndex = 0;
+    if( step->flags & SPI_DMA ) {
+        startDma();
+    }
+    else {
+        SpibRegs.SPIFFRX.bit.RXFFIENA = 1;
+        loadChunk();
+    }
 }
 
-void SPIBus :: sendWord(Uint16 data)
+void SPIBus :: loadChunk(void)
 {
-    SpibRegs.SPICTL.bit.TALK = 1;
-    SpibRegs.SPITXBUF = data;
-    WAIT_FOR_SERIAL;
-    dummy = SpibRegs.SPIRXBUF;
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    this->chunk = step->count - this->wordIndex;
+    if( this->chunk > SPI_FIFO_DEPTH ) {
+        this->chunk = SPI_FIFO_DEPTH;
+    }
+
+    // interrupt once every word in the chunk has been clocked through
+    SpibRegs.SPIFFRX.bit.RXFFIL = this->chunk;
+
+    for( Uint16 i = 0; i < this->chunk; i++ ) {
+        // receiving still needs something clocked out
+        SpibRegs.SPITXBUF = (step->flags & SPI_SEND) ? step->data[this->wordIndex + i] : 0;
+    }
 }
 
-Uint16 SPIBus :: receiveWord(void) {
-    SpibRegs.SPICTL.bit.TALK = 0;
-    SpibRegs.SPITXBUF = dummy;
-    WAIT_FOR_SERIAL;
-    return SpibRegs.SPIRXBUF & mask; // mask off if we're in 8-bit mode
+void SPIBus :: startDma(void)
+{
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    // the receive channel takes the FIFO level trigger from here on
+    SpibRegs.SPIFFRX.bit.RXFFIENA = 0;
+    SpibRegs.SPIFFRX.bit.RXFFIL = 1;
+
+    if( step->flags & SPI_SEND ) {
+        DMACH5AddrConfig(&SpibRegs.SPITXBUF, step->data);
+        DMACH5TransferConfig(step->count - 1, 1, 0);
+        DMACH6AddrConfig(&dmaSink, &SpibRegs.SPIRXBUF);
+        DMACH6TransferConfig(step->count - 1, 0, 0);
+    }
+    else {
+        DMACH5AddrConfig(&SpibRegs.SPITXBUF, &dmaFill);
+        DMACH5TransferConfig(step->count - 1, 0, 0);
+        DMACH6AddrConfig(step->data, &SpibRegs.SPIRXBUF);
+        DMACH6TransferConfig(step->count - 1, 0, 1);
+    }
+
+    // drop any stale triggers, start the receive side first, then kick the
+    // transmit side, since its FIFO is already empty
+    EALLOW;
+    DMA_RX.CONTROL.bit.PERINTCLR = 1;
+    DMA_TX.CONTROL.bit.PERINTCLR = 1;
+    DMA_RX.CONTROL.bit.RUN = 1;
+    DMA_TX.CONTROL.bit.RUN = 1;
+    DMA_TX.CONTROL.bit.PERINTFRC = 1;
+    EDIS;
 }
 
+void SPIBus :: startPause(Uint32 cycles)
+{
+    // one-shot: stopped again in the interrupt
+    CpuTimer1Regs.TCR.bit.TSS = 1;
+    CpuTimer1Regs.PRD.all = cycles;
+    CpuTimer1Regs.TCR.bit.TRB = 1;
+    CpuTimer1Regs.TCR.bit.TIF = 1;
+    CpuTimer1Regs.TCR.bit.TSS = 0;
+}
 
+void SPIBus :: timerISR(void)
+{
+    CpuTimer1Regs.TCR.bit.TSS = 1;
+    CpuTimer1Regs.TCR.bit.TIF = 1;
 
+    // timer 2 counts down, so the deadline has passed once it is below it
+    int32 remaining = (int32)(CpuTimer2Regs.TIM.all - this->deadline);
+    if( remaining > 0 ) {
+        startPause(remaining);
+        return;
+    }
+
+    nextStep();
+}
+
+void SPIBus :: ISR(void)
+{
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    // collect the words clocked in; mask off if we're in 8-bit mode
+    for( Uint16 i = 0; i < this->chunk; i++ ) {
+        Uint16 word = SpibRegs.SPIRXBUF & this->mask;
+        if( ! (step->flags & SPI_SEND) ) {
+            step->data[this->wordIndex + i] = word;
+        }
+    }
+    this->wordIndex += this->chunk;
+    SpibRegs.SPIFFRX.bit.RXFFINTCLR = 1;
+
+    if( this->wordIndex < step->count ) {
+        loadChunk();
+        return;
+    }
+
+    finishStep();
+}
 
+void SPIBus :: dmaISR(void)
+{
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    // 8-bit words arrive right-justified with junk above them
+    if( !(step->flags & SPI_SEND) && this->mask != 0xffff ) {
+        for( Uint16 i = 0; i < step->count; i++ ) {
+            step->data[i] &= this->mask;
+        }
+    }
+    SpibRegs.SPIFFRX.bit.RXFFINTCLR = 1;
+
+    finishStep();
+}
+
+void SPIBus :: finishStep(void)
+{
+    SPI_STEP *step = &this->active->steps[this->stepIndex];
+
+    if( step->flags & SPI_RELEASE ) {
+        GpioDataRegs.GPBSET.all = this->active->device->chipSelect;
+        this->selected = false;
+    }
+
+    // carry on when the pause is over; the bus sits idle meanwhile
+    if( step->delayUs > 0 ) {
+        Uint32 cycles = (Uint32)step->delayUs * CPU_CLOCK_MHZ;
+        this->deadline = CpuTimer2Regs.TIM.all - cycles;
+        startPause(cycles);
+        return;
+    }
+
+    nextStep();
+}
+
+void SPIBus :: nextStep(void)
+{
+    if( ++this->stepIndex < this->active->stepCount ) {
+        startStep();
+        return;
+    }
+
+    // transaction complete; never leave a device selected
+    if( this->selected ) {
+        GpioDataRegs.GPBSET.all = this->active->device->chipSelect;
+        this->selected = false;
+    }
+    SpibRegs.SPICTL.bit.TALK = 0;
+    this->active->busy = false;
+
+    startNext();
+}
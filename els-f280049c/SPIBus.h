@@ -28,33 +28,125 @@
 #define __SPI_BUS_H
 
 #include "F28x_Project.h"
+#include "Configuration.h"
+
+
+// Depth of the SPI transmit and receive FIFOs
+#define SPI_FIFO_DEPTH 16
+
+// Transactions that can wait for the bus at once
+#define SPI_QUEUE_LENGTH 4
+
+// SPI_DEVICE flags
+#define SPI_SIXTEEN_BITS    0x0002  // 16-bit words; otherwise 8-bit
+#define SPI_THREE_WIRE      0x0004  // shared data line; otherwise separate SIMO/SOMI
+
+// SPI_STEP flags
+#define SPI_SEND            0x0001  // drive the data line; otherwise the step receives
+// SPI_SIXTEEN_BITS         0x0002  // 16-bit words, whatever the device default
+#define SPI_RELEASE         0x0008  // release chip select at the end of the step
+#define SPI_DMA             0x0010  // data is in GSRAM; move it by DMA instead of the CPU
+#define SPI_EIGHT_BITS      0x0020  // 8-bit words, whatever the device default
+
+// SPI_DEVICE priorities; a waiting transaction with a higher priority gets
+// the bus first
+#define SPI_PRIORITY_LOW    0
+#define SPI_PRIORITY_HIGH   1
+
+
+//
+// How a device on the bus wants it set up.  The bus only changes the wire
+// mode and clock when it moves from one device to another.
+//
+typedef struct SPI_DEVICE
+{
+    Uint32 chipSelect;      // mask of the (active low) chip select on GPIO32-63
+    Uint16 flags;           // wire mode and default word size
+    Uint16 bitRate;         // SPIBRR: bit rate = LSPCLK / (bitRate + 1)
+    Uint16 priority;
+} SPI_DEVICE;
+
+
+//
+// One step of a transaction: a run of words sent or received in the same
+// direction and word size, optionally followed by a chip select release and
+// a pause
+//
+typedef struct SPI_STEP
+{
+    Uint16 flags;
+    Uint16 count;
+    Uint16 *data;           // words to send, or where to put the words received
+    Uint16 delayUs;         // pause after the step, before the next one starts
+} SPI_STEP;
+
+//
+// A complete exchange with one device.  Chip select is asserted at the start
+// of the first step and again after each release.
+//
+typedef struct SPI_TRANSACTION
+{
+    const SPI_DEVICE *device;
+    SPI_STEP *steps;
+    Uint16 stepCount;
+    volatile bool busy;     // set on submit, cleared when the last step is done
+} SPI_TRANSACTION;
+
 
 class SPIBus
 {
 private:
-    // dummy register, for SPI
-    Uint16 dummy;
+    // transactions waiting for the bus, oldest first
+    SPI_TRANSACTION *queue[SPI_QUEUE_LENGTH];
+    Uint16 queueCount;
+
+    // device the bus is set up for, and the current word size
+    const SPI_DEVICE *device;
+    bool sixteenBits;
+
+    // transaction on the bus, and how far it has got
+    SPI_TRANSACTION *active;
+    Uint16 stepIndex;
+    Uint16 wordIndex;
+    Uint16 chunk;
+    bool selected;
 
     // mask used to discard high bits on receive
     Uint16 mask;
 
+    // timer 2 count at which the current pause ends
+    Uint32 deadline;
+
+    void startNext(void);
+    void configure(const SPI_DEVICE *device);
+    void startStep(void);
+    void loadChunk(void);
+    void startDma(void);
+    void finishStep(void);
+    void nextStep(void);
+    void startPause(Uint32 cycles);
+
 public:
     SPIBus(void);
 
     // initialize the hardware for operation
     void initHardware(void);
 
-    void setThreeWire( void );
-    void setFourWire( void );
-    void setEightBits( void );
-    void setSixteenBits( void );
+    // queue a transaction to run in the background, after any already waiting
+    // at the same or higher priority; false if the queue is full
+    bool submit(SPI_TRANSACTION *transaction);
+
+    // queue a transaction and wait for it; interrupts must be enabled
+    void transfer(SPI_TRANSACTION *transaction);
 
-    // transmit one word of data
-    void sendWord(Uint16 data);
+    // receive FIFO interrupt: the words loaded so far have all been clocked
+    void ISR(void);
 
-    // receive one word of data
-    Uint16 receiveWord(void);
+    // receive DMA interrupt: every word of a DMA step has been clocked
+    void dmaISR(void);
 
+    // timer 1 interrupt: the pause after a step should be over
+    void timerISR(void);
 };
 
 
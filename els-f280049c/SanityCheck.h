@@ -32,12 +32,32 @@
 #error STEPPER_CYCLE_US must be between 5ms and 100ms
 #endif
 
+#if IDLE_CYCLE_US < STEPPER_CYCLE_US || IDLE_CYCLE_US > 10000
+#error IDLE_CYCLE_US must be between STEPPER_CYCLE_US and 10000us
+#endif
+
+#if IDLE_DELAY_MS < 1 || IDLE_DELAY_MS > 10000
+#error IDLE_DELAY_MS must be between 1ms and 10000ms
+#endif
+
 #if UI_REFRESH_RATE_HZ < 3 || UI_REFRESH_RATE_HZ > 100
 #error UI_REFRESH_RATE_HZ must be between 1Hz and 100Hz
 #endif
 
-#if RPM_CALC_RATE_HZ < 1 || RPM_CALC_RATE_HZ > 10
-#error RPM_CALC_RATE_HZ must be between 1Hz and 10Hz
+#if KEY_SCAN_RATE_HZ < 10 || KEY_SCAN_RATE_HZ > 1000
+#error KEY_SCAN_RATE_HZ must be between 10Hz and 1000Hz
+#endif
+
+#if RPM_CALC_RATE_HZ < 1 || RPM_CALC_RATE_HZ > UI_REFRESH_RATE_HZ
+#error RPM_CALC_RATE_HZ must be between 1Hz and UI_REFRESH_RATE_HZ
+#endif
+
+#if SETTINGS_SAVE_RATE_HZ < 1 || SETTINGS_SAVE_RATE_HZ > 100
+#error SETTINGS_SAVE_RATE_HZ must be between 1Hz and 100Hz
+#endif
+
+#if TELEMETRY_RATE_HZ < 1 || TELEMETRY_RATE_HZ > UI_REFRESH_RATE_HZ
+#error TELEMETRY_RATE_HZ must be between 1Hz and UI_REFRESH_RATE_HZ
 #endif
 
 #if CPU_CLOCK_HZ < 1000000 || CPU_CLOCK_HZ > 500000000
@@ -56,6 +76,10 @@
 #error ENCODER_RESOLUTION must be between 100 and 10000
 #endif
 
+#if ENCODER_GEAR_NUMERATOR < 1 || ENCODER_GEAR_NUMERATOR > 1000 || ENCODER_GEAR_DENOMINATOR < 1 || ENCODER_GEAR_DENOMINATOR > 1000
+#error ENCODER_GEAR_NUMERATOR and ENCODER_GEAR_DENOMINATOR must be between 1 and 1000
+#endif
+
 #if defined(LEADSCREW_TPI) && defined(LEADSCREW_HMM)
 #error LEADSCREW_TPI and LEADSCREW_HMM may not both be defined.  Choose only one.
 #endif
@@ -72,8 +96,73 @@
 #endif
 #endif
 
+#if ENCODER_ERROR_WARNING < 1
+#error ENCODER_ERROR_WARNING must be at least 1
+#endif
+
+#if ENCODER_INDEX_TOLERANCE < 0 || ENCODER_INDEX_TOLERANCE >= ENCODER_RESOLUTION / 4
+#error ENCODER_INDEX_TOLERANCE must be between 0 and a quarter of ENCODER_RESOLUTION
+#endif
+
+#if defined(USE_INDEX_CORRECTION) && ENCODER_INDEX_ALARM_COUNTS <= ENCODER_INDEX_TOLERANCE
+#error ENCODER_INDEX_ALARM_COUNTS must be greater than ENCODER_INDEX_TOLERANCE
+#endif
+
+#if ENCODER_SPEED_SAMPLES < 2 || ENCODER_SPEED_SAMPLES > ENCODER_RESOLUTION / 16
+#error ENCODER_SPEED_SAMPLES must be between 2 and a sixteenth of ENCODER_RESOLUTION
+#endif
+
+#if ENCODER_MAX_RPM < 100 || ENCODER_MAX_RPM > 10000
+#error ENCODER_MAX_RPM must be between 100 and 10000
+#endif
+
+#if ENCODER_QUALIFY_SECONDS < 1 || ENCODER_QUALIFY_SECONDS > 60
+#error ENCODER_QUALIFY_SECONDS must be between 1 and 60
+#endif
+
+#if ENCODER_CALIBRATION_REVS < 1 || ENCODER_CALIBRATION_REVS > 100
+#error ENCODER_CALIBRATION_REVS must be between 1 and 100
+#endif
+
 #if defined(ENCODER_USE_EQEP1) && defined (ENCODER_USE_EQEP2)
-#error Define only one of ENCODER_USE_EQEP1 or ENCODER_USE_EQEP2
+#error Define only one of ENCODER_USE_EQEP1 or ENCODER_USE_EQEP2 for the spindle encoder
+#endif
+
+#if defined(USE_LEADSCREW_ENCODER)
+#if LEADSCREW_ENCODER_RESOLUTION < 100 || LEADSCREW_ENCODER_RESOLUTION > 100000
+#error LEADSCREW_ENCODER_RESOLUTION must be between 100 and 100000
+#endif
+#if LEADSCREW_ENCODER_DEADBAND_STEPS < 1 || LEADSCREW_ENCODER_DEADBAND_STEPS >= LEADSCREW_ENCODER_FAULT_STEPS
+#error LEADSCREW_ENCODER_DEADBAND_STEPS must be at least 1 and less than LEADSCREW_ENCODER_FAULT_STEPS
+#endif
+#if STEPPER_MICROSTEPS_FEED != STEPPER_MICROSTEPS || STEPPER_RESOLUTION_FEED != STEPPER_RESOLUTION
+#error USE_LEADSCREW_ENCODER requires the same drive ratio for feeds and threads
+#endif
+#endif
+
+#if RESUME_MAX_RATE < 1 || RESUME_MAX_RATE * STEPPER_CYCLE_US * 2 > 1000000
+#error RESUME_MAX_RATE must be at least 1 and no more than one step every two stepper cycles
+#endif
+#if RESUME_ACCELERATION * STEPPER_CYCLE_US < 15259
+#error RESUME_ACCELERATION is too low to resolve at this STEPPER_CYCLE_US
+#endif
+
+#if defined(USE_HANDWHEEL)
+#if defined(USE_LEADSCREW_ENCODER)
+#error USE_HANDWHEEL and USE_LEADSCREW_ENCODER both need the auxiliary eQEP; define only one
+#endif
+#if HANDWHEEL_COUNTS_PER_DETENT < 1 || HANDWHEEL_COUNTS_PER_DETENT > 16
+#error HANDWHEEL_COUNTS_PER_DETENT must be between 1 and 16
+#endif
+#if HANDWHEEL_STEPS_PER_DETENT < 1 || HANDWHEEL_STEPS_PER_DETENT > 100
+#error HANDWHEEL_STEPS_PER_DETENT must be between 1 and 100
+#endif
+#if HANDWHEEL_MAX_RATE < 1 || HANDWHEEL_MAX_RATE * STEPPER_CYCLE_US * 2 > 1000000
+#error HANDWHEEL_MAX_RATE must be at least 1 and no more than one step every two stepper cycles
+#endif
+#if HANDWHEEL_ACCELERATION * STEPPER_CYCLE_US < 15259
+#error HANDWHEEL_ACCELERATION is too low to resolve at this STEPPER_CYCLE_US
+#endif
 #endif
 
 
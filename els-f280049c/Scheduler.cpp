@@ -0,0 +1,123 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "Scheduler.h"
+
+
+// Timer 2 counts down from here, so a deadline has passed once the count is
+// at or below it
+#define TIMER_NOW CpuTimer2Regs.TIM.all
+#define IS_PAST(now, deadline) ((int32)((now) - (deadline)) <= 0)
+
+
+Scheduler :: Scheduler( void )
+{
+    this->taskCount = 0;
+}
+
+void Scheduler :: initHardware(void)
+{
+    // CPU timer 2 runs free at SYSCLK
+    CpuTimer2Regs.TCR.bit.TSS = 1;
+    CpuTimer2Regs.PRD.all = 0xffffffff;
+    CpuTimer2Regs.TPR.all = 0;
+    CpuTimer2Regs.TPRH.all = 0;
+    CpuTimer2Regs.TCR.bit.TRB = 1;
+    CpuTimer2Regs.TCR.bit.TSS = 0;
+}
+
+Uint16 Scheduler :: addTask(void (*run)(void), Uint32 periodUs)
+{
+    if( this->taskCount >= SCHEDULER_MAX_TASKS ) {
+        return SCHEDULER_MAX_TASKS;
+    }
+
+    TASK *task = &this->tasks[this->taskCount];
+
+    task->run = run;
+    task->period = periodUs * CPU_CLOCK_MHZ;
+    task->due = TIMER_NOW;
+    task->overruns = 0;
+    task->skipped = 0;
+
+    return this->taskCount++;
+}
+
+Uint32 Scheduler :: getTotalOverruns(void)
+{
+    Uint32 total = 0;
+    for( Uint16 i = 0; i < this->taskCount; i++ ) {
+        total += this->tasks[i].overruns;
+    }
+    return total;
+}
+
+Uint32 Scheduler :: getTotalSkipped(void)
+{
+    Uint32 total = 0;
+    for( Uint16 i = 0; i < this->taskCount; i++ ) {
+        total += this->tasks[i].skipped;
+    }
+    return total;
+}
+
+void Scheduler :: start(void)
+{
+    Uint32 now = TIMER_NOW;
+
+    for( Uint16 i = 0; i < this->taskCount; i++ ) {
+        this->tasks[i].due = now;
+    }
+}
+
+void Scheduler :: runDue(void)
+{
+    for( Uint16 i = 0; i < this->taskCount; i++ ) {
+        TASK *task = &this->tasks[i];
+        Uint32 start = TIMER_NOW;
+
+        if( ! IS_PAST(start, task->due) ) {
+            continue;
+        }
+
+        task->run();
+
+        Uint32 end = TIMER_NOW;
+        if( start - end > task->period ) {
+            task->overruns++;
+        }
+
+        // the next run is due a period after this one was due, not after it
+        // ran, so the rate doesn't drift with the work done
+        task->due -= task->period;
+
+        // but don't try to catch up on runs that are already a period late
+        while( IS_PAST(end, task->due - task->period) ) {
+            task->due -= task->period;
+            task->skipped++;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include "F28x_Project.h"
+#include "Configuration.h"
+
+
+// Most tasks the main loop can run
+#define SCHEDULER_MAX_TASKS 8
+
+
+typedef struct TASK
+{
+    void (*run)(void);
+    Uint32 period;          // CPU cycles between runs
+    Uint32 due;             // timer 2 count when the next run is due
+    Uint32 overruns;        // runs that took longer than the period
+    Uint32 skipped;         // runs dropped because the task fell a whole period behind
+} TASK;
+
+
+class Scheduler
+{
+private:
+    TASK tasks[SCHEDULER_MAX_TASKS];
+    Uint16 taskCount;
+
+public:
+    Scheduler(void);
+
+    // start the free-running timer that is the time base for the tasks,
+    // and for the SPI bus pauses
+    void initHardware(void);
+
+    // add a task to run every periodUs; tasks that fall due together run in
+    // the order they were added.  Returns the task number, or
+    // SCHEDULER_MAX_TASKS if the table is full and the task wasn't added.
+    Uint16 addTask(void (*run)(void), Uint32 periodUs);
+
+    // make every task due now
+    void start(void);
+
+    // run whatever is due; call continuously
+    void runDue(void);
+
+    // overrun counters for a task, and summed over all of them
+    Uint32 getOverruns(Uint16 task);
+    Uint32 getSkipped(Uint16 task);
+    Uint32 getTotalOverruns(void);
+    Uint32 getTotalSkipped(void);
+};
+
+
+inline Uint32 Scheduler :: getOverruns(Uint16 task)
+{
+    return this->tasks[task].overruns;
+}
+
+inline Uint32 Scheduler :: getSkipped(Uint16 task)
+{
+    return this->tasks[task].skipped;
+}
+
+
+#endif // __SCHEDULER_H
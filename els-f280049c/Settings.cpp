@@ -0,0 +1,92 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "Settings.h"
+
+
+Settings :: Settings(EEPROM *eeprom)
+{
+    this->eeprom = eeprom;
+
+    for( Uint16 i = 0; i < EEPROM_PAGE_SIZE; i++ ) {
+        this->page[i] = 0;
+    }
+    this->dirty = false;
+}
+
+Uint16 Settings :: checksum(void)
+{
+    // simple sum, inverted so an all-zero page doesn't pass
+    Uint16 sum = 0;
+    for( Uint16 i = 0; i < SETTINGS_WORD_CHECKSUM; i++ ) {
+        sum += this->page[i];
+    }
+    return ~sum;
+}
+
+Uint16 Settings :: get(Uint16 word)
+{
+    return this->page[word];
+}
+
+void Settings :: set(Uint16 word, Uint16 value)
+{
+    if( this->page[word] != value ) {
+        this->page[word] = value;
+        this->dirty = true;
+    }
+}
+
+void Settings :: load(void)
+{
+    eeprom->readPage(SETTINGS_PAGE, this->page);
+
+    if( this->page[SETTINGS_WORD_SIGNATURE] != SETTINGS_SIGNATURE ||
+        this->page[SETTINGS_WORD_CHECKSUM] != checksum() )
+    {
+        // blank or corrupt: every setting reads as zero, meaning "not set"
+        for( Uint16 i = 0; i < EEPROM_PAGE_SIZE; i++ ) {
+            this->page[i] = 0;
+        }
+    }
+    this->dirty = false;
+}
+
+void Settings :: save(void)
+{
+    // the last write isn't finished; anything changed since goes out after it
+    if( eeprom->isWriting() ) {
+        return;
+    }
+
+    if( this->dirty ) {
+        this->page[SETTINGS_WORD_SIGNATURE] = SETTINGS_SIGNATURE;
+        this->page[SETTINGS_WORD_CHECKSUM] = checksum();
+        if( eeprom->writePage(SETTINGS_PAGE, this->page) ) {
+            this->dirty = false;
+        }
+    }
+}
@@ -0,0 +1,110 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+#include "F28x_Project.h"
+#include "EEPROM.h"
+
+
+// EEPROM page holding the settings
+#define SETTINGS_PAGE 0
+
+// First word of a valid settings page; change it if the layout changes
+#define SETTINGS_SIGNATURE 0x5E71
+
+// Word offsets within the page
+#define SETTINGS_WORD_SIGNATURE 0
+#define SETTINGS_WORD_ENCODER_RESOLUTION 1
+#define SETTINGS_WORD_INPUT_QUALIFICATION 2
+#define SETTINGS_WORD_CHECKSUM (EEPROM_PAGE_SIZE - 1)
+
+
+class Settings
+{
+private:
+    EEPROM *eeprom;
+
+    // copy of the EEPROM page
+    Uint16 page[EEPROM_PAGE_SIZE];
+    bool dirty;
+
+    Uint16 checksum(void);
+    Uint16 get(Uint16 word);
+    void set(Uint16 word, Uint16 value);
+
+public:
+    Settings(EEPROM *eeprom);
+
+    // read the settings from EEPROM, falling back to defaults if they are blank
+    // or corrupt
+    void load(void);
+
+    // write the settings back in the background, if anything changed; call
+    // it regularly, since it also moves the write along and never waits
+    void save(void);
+
+    // measured encoder counts per revolution; 0 if never calibrated
+    Uint16 getEncoderResolution(void);
+    void setEncoderResolution(Uint16 resolution);
+
+    // encoder input qualification level, valid only once calibrated
+    bool hasInputQualification(void);
+    Uint16 getInputQualification(void);
+    void setInputQualification(Uint16 level);
+};
+
+
+inline Uint16 Settings :: getEncoderResolution(void)
+{
+    return get(SETTINGS_WORD_ENCODER_RESOLUTION);
+}
+
+inline void Settings :: setEncoderResolution(Uint16 resolution)
+{
+    set(SETTINGS_WORD_ENCODER_RESOLUTION, resolution);
+}
+
+
+// stored plus one, so a blank page reads as not calibrated
+inline bool Settings :: hasInputQualification(void)
+{
+    return get(SETTINGS_WORD_INPUT_QUALIFICATION) != 0;
+}
+
+inline Uint16 Settings :: getInputQualification(void)
+{
+    return get(SETTINGS_WORD_INPUT_QUALIFICATION) - 1;
+}
+
+inline void Settings :: setInputQualification(Uint16 level)
+{
+    set(SETTINGS_WORD_INPUT_QUALIFICATION, level + 1);
+}
+
+
+#endif // __SETTINGS_H
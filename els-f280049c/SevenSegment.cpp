@@ -0,0 +1,121 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "SevenSegment.h"
+
+
+static const Uint16 DIGIT_GLYPHS[10] =
+{
+    ZERO, ONE, TWO, THREE, FOUR, FIVE, SIX, SEVEN, EIGHT, NINE
+};
+
+static const Uint16 LETTER_GLYPHS[26] =
+{
+    LETTER_A, LETTER_B, LETTER_C, LETTER_D, LETTER_E, LETTER_F, LETTER_G,
+    LETTER_H, LETTER_I, LETTER_J, LETTER_K, LETTER_L, LETTER_M, LETTER_N,
+    LETTER_O, LETTER_P, LETTER_Q, LETTER_R, LETTER_S, LETTER_T, LETTER_U,
+    LETTER_V, LETTER_W, LETTER_X, LETTER_Y, LETTER_Z
+};
+
+
+Uint16 segmentGlyph(char c)
+{
+    if( c >= '0' && c <= '9' ) return DIGIT_GLYPHS[c - '0'];
+    if( c >= 'A' && c <= 'Z' ) return LETTER_GLYPHS[c - 'A'];
+    if( c >= 'a' && c <= 'z' ) return LETTER_GLYPHS[c - 'a'];
+    if( c == '-' ) return DASH;
+    return BLANK;
+}
+
+void renderText(Uint16 *display, Uint16 width, const char *text)
+{
+    Uint16 i = 0;
+
+    while( *text != 0 && i <= width )
+    {
+        if( *text == '.' )
+        {
+            // a point on its own if there is no character to hang it on
+            if( i == 0 ) display[i++] = POINT;
+            else display[i - 1] |= POINT;
+        }
+        else if( i < width )
+        {
+            display[i++] = segmentGlyph(*text);
+        }
+        else
+        {
+            break;
+        }
+        text++;
+    }
+
+    while( i < width )
+    {
+        display[i++] = BLANK;
+    }
+}
+
+void renderNumber(Uint16 *display, Uint16 width, int32 value, Uint16 decimals)
+{
+    bool negative = value < 0;
+    Uint32 magnitude = negative ? -value : value;
+
+    // clamp to what fits, leaving room for a minus sign
+    Uint32 limit = 1;
+    for( Uint16 i = negative ? 1 : 0; i < width; i++ )
+    {
+        limit *= 10;
+    }
+    if( magnitude > limit - 1 )
+    {
+        magnitude = limit - 1;
+    }
+
+    // digits from the right, at least as far as the units
+    int16 position = width - 1;
+    Uint16 place = 0;
+    do
+    {
+        display[position] = DIGIT_GLYPHS[magnitude % 10];
+        if( decimals > 0 && place == decimals )
+        {
+            display[position] |= POINT;
+        }
+        magnitude /= 10;
+        place++;
+        position--;
+    } while( position >= 0 && (magnitude > 0 || place <= decimals) );
+
+    if( negative && position >= 0 )
+    {
+        display[position--] = DASH;
+    }
+    while( position >= 0 )
+    {
+        display[position--] = BLANK;
+    }
+}
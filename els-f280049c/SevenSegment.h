@@ -0,0 +1,101 @@
+// Clough42 Electronic Leadscrew
+// https://github.com/clough42/electronic-leadscrew
+//
+// MIT License
+//
+// Copyright (c) 2019 James Clough
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef __SEVEN_SEGMENT_H
+#define __SEVEN_SEGMENT_H
+
+#include "F28x_Project.h"
+
+
+//
+// Segment patterns for the TM1638 digits, in the high byte as they go out on
+// the bus
+//
+#define ZERO    0b1111110000000000 // 0
+#define ONE     0b0110000000000000 // 1
+#define TWO     0b1101101000000000 // 2
+#define THREE   0b1111001000000000 // 3
+#define FOUR    0b0110011000000000 // 4
+#define FIVE    0b1011011000000000 // 5
+#define SIX     0b1011111000000000 // 6
+#define SEVEN   0b1110000000000000 // 7
+#define EIGHT   0b1111111000000000 // 8
+#define NINE    0b1111011000000000 // 9
+#define POINT   0b0000000100000000 // .
+#define BLANK   0b0000000000000000
+
+#define LETTER_A 0b1110111000000000
+#define LETTER_B 0b0011111000000000
+#define LETTER_C 0b1001110000000000
+#define LETTER_D 0b0111101000000000
+#define LETTER_E 0b1001111000000000
+#define LETTER_F 0b1000111000000000
+#define LETTER_G 0b1011110000000000
+#define LETTER_H 0b0110111000000000
+#define LETTER_I 0b0000110000000000
+#define LETTER_J 0b0111100000000000
+#define LETTER_K 0b1010111000000000
+#define LETTER_L 0b0001110000000000
+#define LETTER_M 0b1010100000000000
+#define LETTER_N 0b1110110000000000
+#define LETTER_O 0b1111110000000000
+#define LETTER_P 0b1100111000000000
+#define LETTER_Q 0b1110011000000000
+#define LETTER_R 0b1100110000000000
+#define LETTER_S 0b1011011000000000
+#define LETTER_T 0b0001111000000000
+#define LETTER_U 0b0111110000000000
+#define LETTER_V 0b0111010000000000
+#define LETTER_W 0b0101010000000000
+#define LETTER_X 0b0110110000000000
+#define LETTER_Y 0b0111011000000000
+#define LETTER_Z 0b1101001000000000
+
+#define DASH 0b0000001000000000
+
+
+// Digit glyph, for use in constant expressions such as table initializers
+#define SEGMENT_DIGIT(d) \
+    ((d) == 0 ? ZERO : (d) == 1 ? ONE : (d) == 2 ? TWO : (d) == 3 ? THREE : \
+     (d) == 4 ? FOUR : (d) == 5 ? FIVE : (d) == 6 ? SIX : (d) == 7 ? SEVEN : \
+     (d) == 8 ? EIGHT : NINE)
+
+
+// Glyph for a character: digits, letters in either case, '-' and ' '.
+// Anything else is blank.
+Uint16 segmentGlyph(char c);
+
+// Render text left-aligned into width digits, padding with blanks.  A '.'
+// lights the decimal point of the character before it.
+void renderText(Uint16 *display, Uint16 width, const char *text);
+
+// Render a signed fixed-point number right-aligned into width digits, with
+// decimals digits after the point.  Leading zeros are blank, except the units
+// digit.  Values too big for the width show the largest that fits.
+void renderNumber(Uint16 *display, Uint16 width, int32 value, Uint16 decimals);
+
+
+#endif // __SEVEN_SEGMENT_H
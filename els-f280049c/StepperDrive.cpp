@@ -27,14 +27,42 @@
 #include "StepperDrive.h"
 
 
-StepperDrive :: StepperDrive(void)
+StepperDrive :: StepperDrive(Uint16 stepPin, Uint16 directionPin, Uint16 enablePin, Uint16 alarmPin)
 {
+    //
+    // Remember which pins drive this axis
+    //
+    this->stepPin = stepPin;
+    this->directionPin = directionPin;
+    this->enablePin = enablePin;
+    this->alarmPin = alarmPin;
+    this->stepMask = GPIO_MASK(stepPin);
+    this->directionMask = GPIO_MASK(directionPin);
+    this->enableMask = GPIO_MASK(enablePin);
+    this->alarmMask = (alarmPin == NO_ALARM_PIN) ? 0 : GPIO_MASK(alarmPin);
+
     //
     // Set up global state variables
     //
     this->currentPosition = 0;
     this->desiredPosition = 0;
 
+#ifdef USE_LEADSCREW_ENCODER
+    //
+    // Closed-loop feedback starts at the origin, with no history
+    //
+    this->positionOffset = 0;
+    this->feedbackReference = 0;
+    this->correctionSteps = 0;
+    this->maxFollowingError = 0;
+    this->feedbackFault = false;
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef MEASURE_STEP_JITTER
+    this->stepEdgeTimer = 0;
+    this->stepEdge = false;
+#endif // MEASURE_STEP_JITTER
+
     //
     // State machine starts at state zero
     //
@@ -45,30 +73,26 @@ void StepperDrive :: initHardware(void)
 {
     //
     // Configure GPIO pins for output
-    // GPIO0 = Step
-    // GPIO1 = Direction
-    // GPIO6 - Enable
-    // GPIO
+    // Step, Direction and Enable are outputs
+    // Alarm is an input
     //
-    EALLOW;
-    GpioCtrlRegs.GPAMUX1.bit.GPIO0 = 0;
-    GpioCtrlRegs.GPAMUX1.bit.GPIO1 = 0;
-    GpioCtrlRegs.GPAMUX1.bit.GPIO6 = 0;
-    GpioCtrlRegs.GPAMUX1.bit.GPIO7 = 0;
+    GPIO_SetupPinMux(this->stepPin, GPIO_MUX_CPU1, 0);
+    GPIO_SetupPinMux(this->directionPin, GPIO_MUX_CPU1, 0);
+    GPIO_SetupPinMux(this->enablePin, GPIO_MUX_CPU1, 0);
 
-    GpioCtrlRegs.GPADIR.bit.GPIO0 = 1;
-    GpioCtrlRegs.GPADIR.bit.GPIO1 = 1;
-    GpioCtrlRegs.GPADIR.bit.GPIO6 = 1;
-    GpioCtrlRegs.GPADIR.bit.GPIO7 = 0; // input
+    GPIO_SetupPinOptions(this->stepPin, GPIO_OUTPUT, GPIO_PUSHPULL);
+    GPIO_SetupPinOptions(this->directionPin, GPIO_OUTPUT, GPIO_PUSHPULL);
+    GPIO_SetupPinOptions(this->enablePin, GPIO_OUTPUT, GPIO_PUSHPULL);
 
+    if( this->alarmPin != NO_ALARM_PIN )
+    {
+        GPIO_SetupPinMux(this->alarmPin, GPIO_MUX_CPU1, 0);
+        GPIO_SetupPinOptions(this->alarmPin, GPIO_INPUT, GPIO_SYNC);
+    }
+
+    EALLOW;
     GPIO_CLEAR_STEP;
     GPIO_CLEAR_DIRECTION;
     GPIO_SET_ENABLE;
     EDIS;
 }
-
-
-
-
-
-
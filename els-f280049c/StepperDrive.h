@@ -31,43 +31,54 @@
 #include "Configuration.h"
 
 
-#define STEP_PIN GPIO0
-#define DIRECTION_PIN GPIO1
-#define ENABLE_PIN GPIO6
-#define ALARM_PIN GPIO7
+// Leadscrew axis pins (port A GPIO numbers)
+#define STEP_PIN 0
+#define DIRECTION_PIN 1
+#define ENABLE_PIN 6
+#define ALARM_PIN 7
 
-#define GPIO_SET(pin) GpioDataRegs.GPASET.bit.pin = 1
-#define GPIO_CLEAR(pin) GpioDataRegs.GPACLEAR.bit.pin = 1
-#define GPIO_GET(pin) GpioDataRegs.GPADAT.bit.pin
+// Cross-slide axis pins (port A GPIO numbers)
+#define CROSS_SLIDE_STEP_PIN 4
+#define CROSS_SLIDE_DIRECTION_PIN 5
+#define CROSS_SLIDE_ENABLE_PIN 8
+#define CROSS_SLIDE_ALARM_PIN 9
+
+// Use in place of an alarm pin number for a drive without alarm feedback
+#define NO_ALARM_PIN 0xffff
+
+#define GPIO_MASK(pin) (1UL << (pin))
+#define GPIO_SET(mask) GpioDataRegs.GPASET.all = (mask)
+#define GPIO_CLEAR(mask) GpioDataRegs.GPACLEAR.all = (mask)
+#define GPIO_GET(mask) (GpioDataRegs.GPADAT.all & (mask))
 
 #ifdef INVERT_STEP_PIN
-#define GPIO_SET_STEP GPIO_CLEAR(STEP_PIN)
-#define GPIO_CLEAR_STEP GPIO_SET(STEP_PIN)
+#define GPIO_SET_STEP GPIO_CLEAR(this->stepMask)
+#define GPIO_CLEAR_STEP GPIO_SET(this->stepMask)
 #else
-#define GPIO_SET_STEP GPIO_SET(STEP_PIN)
-#define GPIO_CLEAR_STEP GPIO_CLEAR(STEP_PIN)
+#define GPIO_SET_STEP GPIO_SET(this->stepMask)
+#define GPIO_CLEAR_STEP GPIO_CLEAR(this->stepMask)
 #endif
 
 #ifdef INVERT_DIRECTION_PIN
-#define GPIO_SET_DIRECTION GPIO_CLEAR(DIRECTION_PIN)
-#define GPIO_CLEAR_DIRECTION GPIO_SET(DIRECTION_PIN)
+#define GPIO_SET_DIRECTION GPIO_CLEAR(this->directionMask)
+#define GPIO_CLEAR_DIRECTION GPIO_SET(this->directionMask)
 #else
-#define GPIO_SET_DIRECTION GPIO_SET(DIRECTION_PIN)
-#define GPIO_CLEAR_DIRECTION GPIO_CLEAR(DIRECTION_PIN)
+#define GPIO_SET_DIRECTION GPIO_SET(this->directionMask)
+#define GPIO_CLEAR_DIRECTION GPIO_CLEAR(this->directionMask)
 #endif
 
 #ifdef INVERT_ENABLE_PIN
-#define GPIO_SET_ENABLE GPIO_CLEAR(ENABLE_PIN)
-#define GPIO_CLEAR_ENABLE GPIO_SET(ENABLE_PIN)
+#define GPIO_SET_ENABLE GPIO_CLEAR(this->enableMask)
+#define GPIO_CLEAR_ENABLE GPIO_SET(this->enableMask)
 #else
-#define GPIO_SET_ENABLE GPIO_SET(ENABLE_PIN)
-#define GPIO_CLEAR_ENABLE GPIO_CLEAR(ENABLE_PIN)
+#define GPIO_SET_ENABLE GPIO_SET(this->enableMask)
+#define GPIO_CLEAR_ENABLE GPIO_CLEAR(this->enableMask)
 #endif
 
 #ifdef INVERT_ALARM_PIN
-#define GPIO_GET_ALARM (GPIO_GET(ALARM_PIN) == 0)
+#define GPIO_GET_ALARM (GPIO_GET(this->alarmMask) == 0)
 #else
-#define GPIO_GET_ALARM (GPIO_GET(ALARM_PIN) != 0)
+#define GPIO_GET_ALARM (GPIO_GET(this->alarmMask) != 0)
 #endif
 
 
@@ -91,11 +102,49 @@ private:
     //
     Uint16 state;
 
+    //
+    // GPIO pin numbers and port A bit masks for this drive
+    //
+    Uint16 stepPin;
+    Uint16 directionPin;
+    Uint16 enablePin;
+    Uint16 alarmPin;
+    Uint32 stepMask;
+    Uint32 directionMask;
+    Uint32 enableMask;
+    Uint32 alarmMask;
+
+#ifdef USE_LEADSCREW_ENCODER
+    //
+    // Closed-loop feedback: currentPosition minus positionOffset is the number
+    // of steps actually issued since the feedback reference was taken
+    //
+    int32 positionOffset;
+    int32 feedbackReference;
+
+    //
+    // Feedback statistics
+    //
+    Uint32 correctionSteps;
+    int32 maxFollowingError;
+    bool feedbackFault;
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef MEASURE_STEP_JITTER
+    //
+    // CPU timer 0 count when the last STEP rising edge was written
+    //
+    Uint32 stepEdgeTimer;
+    bool stepEdge;
+#endif // MEASURE_STEP_JITTER
+
 public:
-    StepperDrive();
+    StepperDrive(Uint16 stepPin, Uint16 directionPin, Uint16 enablePin, Uint16 alarmPin);
     void initHardware(void);
 
     void setDesiredPosition(int32 steps);
+    int32 getDesiredPosition(void);
+    int32 getCurrentPosition(void);
     void incrementCurrentPosition(int32 increment);
     void setCurrentPosition(int32 position);
 
@@ -103,21 +152,69 @@ public:
 
     bool isAlarm();
 
+#ifdef USE_LEADSCREW_ENCODER
+    // closed-loop correction against a measured position, in steps
+    void resetFeedback(int32 actualSteps);
+    void correctPosition(int32 actualSteps);
+
+    Uint32 getCorrectionSteps(void);
+    int32 getMaxFollowingError(void);
+    bool isFeedbackFault(void);
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef MEASURE_STEP_JITTER
+    // timer value of the STEP edge written since the last call, if there was one
+    bool getStepEdge(Uint32 *timer);
+#endif // MEASURE_STEP_JITTER
+
     void ISR(void);
+
+    // finish a step pulse in progress, but don't start a new one
+    void holdISR(void);
+
+    // finish a step pulse in progress, then jump to the desired position
+    // without stepping, for when the drive is disabled
+    void followISR(void);
+
+    // true when the drive has reached the desired position and is not stepping
+    bool isAtTarget(void);
 };
 
+// The position, feedback and hold/follow helpers are called from the stepper
+// interrupt; see Core::ISR
+#pragma FUNC_ALWAYS_INLINE
 inline void StepperDrive :: setDesiredPosition(int32 steps)
 {
     this->desiredPosition = steps;
 }
 
+#pragma FUNC_ALWAYS_INLINE
+inline int32 StepperDrive :: getDesiredPosition(void)
+{
+    return this->desiredPosition;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline int32 StepperDrive :: getCurrentPosition(void)
+{
+    return this->currentPosition;
+}
+
+#pragma FUNC_ALWAYS_INLINE
 inline void StepperDrive :: incrementCurrentPosition(int32 increment)
 {
     this->currentPosition += increment;
+#ifdef USE_LEADSCREW_ENCODER
+    this->positionOffset += increment;
+#endif // USE_LEADSCREW_ENCODER
 }
 
+#pragma FUNC_ALWAYS_INLINE
 inline void StepperDrive :: setCurrentPosition(int32 position)
 {
+#ifdef USE_LEADSCREW_ENCODER
+    this->positionOffset += position - this->currentPosition;
+#endif // USE_LEADSCREW_ENCODER
     this->currentPosition = position;
 }
 
@@ -132,16 +229,93 @@ inline void StepperDrive :: setEnabled(bool enabled)
     }
 }
 
+#pragma FUNC_ALWAYS_INLINE
 inline bool StepperDrive :: isAlarm()
 {
 #ifdef USE_ALARM_PIN
-    return GPIO_GET_ALARM;
+    return this->alarmPin != NO_ALARM_PIN && GPIO_GET_ALARM;
 #else
     return false;
 #endif
 }
 
+#ifdef USE_LEADSCREW_ENCODER
+#pragma FUNC_ALWAYS_INLINE
+inline void StepperDrive :: resetFeedback(int32 actualSteps)
+{
+    this->positionOffset = this->currentPosition;
+    this->feedbackReference = actualSteps;
+    this->feedbackFault = false;
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void StepperDrive :: correctPosition(int32 actualSteps)
+{
+    // positive error means the motor is behind the steps we issued
+    int32 error = (this->currentPosition - this->positionOffset) - (actualSteps - this->feedbackReference);
+    int32 magnitude = (error < 0) ? -error : error;
+
+    if( magnitude > this->maxFollowingError ) {
+        this->maxFollowingError = magnitude;
+    }
+
+    if( magnitude >= LEADSCREW_ENCODER_FAULT_STEPS ) {
+        this->feedbackFault = true;
+    }
 
+    // don't chase an encoder we can't trust
+    if( this->feedbackFault ) {
+        return;
+    }
+
+    // pretend one step fewer (or more) was issued, so the state machine issues a
+    // correction step; this is rate-limited by how often we're called
+    if( error > LEADSCREW_ENCODER_DEADBAND_STEPS ) {
+        this->currentPosition--;
+        this->correctionSteps++;
+    }
+    else if( error < -LEADSCREW_ENCODER_DEADBAND_STEPS ) {
+        this->currentPosition++;
+        this->correctionSteps++;
+    }
+}
+
+inline Uint32 StepperDrive :: getCorrectionSteps(void)
+{
+    return this->correctionSteps;
+}
+
+inline int32 StepperDrive :: getMaxFollowingError(void)
+{
+    return this->maxFollowingError;
+}
+
+inline bool StepperDrive :: isFeedbackFault(void)
+{
+    return this->feedbackFault;
+}
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef MEASURE_STEP_JITTER
+#pragma FUNC_ALWAYS_INLINE
+inline bool StepperDrive :: getStepEdge(Uint32 *timer)
+{
+    if( this->stepEdge ) {
+        *timer = this->stepEdgeTimer;
+        this->stepEdge = false;
+        return true;
+    }
+    return false;
+}
+
+#define STEP_EDGE_TIMESTAMP this->stepEdgeTimer = CpuTimer0Regs.TIM.all; this->stepEdge = true
+#else
+#define STEP_EDGE_TIMESTAMP
+#endif // MEASURE_STEP_JITTER
+
+
+// Always inlined into the timer interrupt along with Core::ISR
+#pragma FUNC_ALWAYS_INLINE
 inline void StepperDrive :: ISR(void)
 {
     switch( this->state ) {
@@ -150,6 +324,7 @@ inline void StepperDrive :: ISR(void)
         // Step = 0; Dir = 0
         if( this->desiredPosition < this->currentPosition ) {
             GPIO_SET_STEP;
+            STEP_EDGE_TIMESTAMP;
             this->state = 2;
         }
         else if( this->desiredPosition > this->currentPosition ) {
@@ -162,6 +337,7 @@ inline void StepperDrive :: ISR(void)
         // Step = 0; Dir = 1
         if( this->desiredPosition > this->currentPosition ) {
             GPIO_SET_STEP;
+            STEP_EDGE_TIMESTAMP;
             this->state = 3;
         }
         else if( this->desiredPosition < this->currentPosition ) {
@@ -186,4 +362,27 @@ inline void StepperDrive :: ISR(void)
     }
 }
 
+#pragma FUNC_ALWAYS_INLINE
+inline void StepperDrive :: holdISR(void)
+{
+    // states 2 and 3 have the step pin high; let them complete normally so the
+    // pulse is counted and the pin is left low
+    if( this->state >= 2 ) {
+        ISR();
+    }
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline void StepperDrive :: followISR(void)
+{
+    holdISR();
+    setCurrentPosition(this->desiredPosition);
+}
+
+#pragma FUNC_ALWAYS_INLINE
+inline bool StepperDrive :: isAtTarget(void)
+{
+    return this->desiredPosition == this->currentPosition && this->state < 2;
+}
+
 #endif // __STEPPERDRIVE_H
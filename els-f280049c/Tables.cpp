@@ -27,6 +27,20 @@
 #include "Tables.h"
 
 
+//
+// Encoder counts per spindle revolution, as a fraction, so a geared encoder
+// folds into each ratio exactly.  Every ratio below is steps per spindle
+// revolution divided by SPINDLE_COUNTS_NUMERATOR / SPINDLE_COUNTS_DENOMINATOR.
+//
+#define SPINDLE_COUNTS_NUMERATOR ((Uint64)ENCODER_RESOLUTION*ENCODER_GEAR_NUMERATOR)
+#define SPINDLE_COUNTS_DENOMINATOR ENCODER_GEAR_DENOMINATOR
+
+//
+// The display data for each row is built from its value at compile time.
+//
+#define PLACE_DIGIT(value, place) SEGMENT_DIGIT(((value) / (place)) % 10)
+
+
 //
 // INCH THREAD DEFINITIONS
 //
@@ -34,42 +48,50 @@
 // LED indicator states and gear ratio fraction to use.
 //
 #if defined(LEADSCREW_TPI)
-#define TPI_NUMERATOR(tpi) ((Uint64)LEADSCREW_TPI*STEPPER_RESOLUTION*STEPPER_MICROSTEPS*10)
-#define TPI_DENOMINATOR(tpi) ((Uint64)tpi*ENCODER_RESOLUTION)
+#define TPI_NUMERATOR(tpi) ((Uint64)LEADSCREW_TPI*STEPPER_RESOLUTION*STEPPER_MICROSTEPS*10*SPINDLE_COUNTS_DENOMINATOR)
+#define TPI_DENOMINATOR(tpi) ((Uint64)tpi*SPINDLE_COUNTS_NUMERATOR)
 #endif
 #if defined(LEADSCREW_HMM)
-#define TPI_NUMERATOR(tpi) ((Uint64)254*100*STEPPER_RESOLUTION*STEPPER_MICROSTEPS)
-#define TPI_DENOMINATOR(tpi) ((Uint64)tpi*ENCODER_RESOLUTION*LEADSCREW_HMM)
+#define TPI_NUMERATOR(tpi) ((Uint64)254*100*STEPPER_RESOLUTION*STEPPER_MICROSTEPS*SPINDLE_COUNTS_DENOMINATOR)
+#define TPI_DENOMINATOR(tpi) ((Uint64)tpi*SPINDLE_COUNTS_NUMERATOR*LEADSCREW_HMM)
 #endif
 #define TPI_FRACTION(tpi) .numerator = TPI_NUMERATOR(tpi), .denominator = TPI_DENOMINATOR(tpi)
 
+// Whole TPI as up to three digits, fractional TPI as dd.d
+#define INCH_THREAD_DISPLAY(tpi) \
+    ((tpi) % 10 == 0 ? ((tpi) >= 10000 ? PLACE_DIGIT(tpi, 10000) : BLANK) : ((tpi) >= 1000 ? PLACE_DIGIT(tpi, 1000) : BLANK)), \
+    ((tpi) % 10 == 0 ? ((tpi) >= 1000 ? PLACE_DIGIT(tpi, 1000) : BLANK) : ((tpi) >= 100 ? PLACE_DIGIT(tpi, 100) : BLANK)), \
+    ((tpi) % 10 == 0 ? ((tpi) >= 100 ? PLACE_DIGIT(tpi, 100) : BLANK) : PLACE_DIGIT(tpi, 10) | POINT), \
+    ((tpi) % 10 == 0 ? PLACE_DIGIT(tpi, 10) : PLACE_DIGIT(tpi, 1))
+#define INCH_THREAD(tpi) { .display = { INCH_THREAD_DISPLAY(tpi) }, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(tpi) }
+
 const FEED_THREAD inch_thread_table[] =
 {
- { .display = {BLANK, BLANK, BLANK, EIGHT}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(80) },
- { .display = {BLANK, BLANK, BLANK, NINE},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(90) },
- { .display = {BLANK, BLANK, ONE,   ZERO},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(100) },
- { .display = {BLANK, BLANK, ONE,   ONE},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(110) },
- { .display = {BLANK, ONE, ONE|POINT,FIVE}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(115) },
- { .display = {BLANK, BLANK, ONE,   TWO},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(120) },
- { .display = {BLANK, BLANK, ONE,   THREE}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(130) },
- { .display = {BLANK, BLANK, ONE,   FOUR},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(140) },
- { .display = {BLANK, BLANK, ONE,   SIX},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(160) },
- { .display = {BLANK, BLANK, ONE,   EIGHT}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(180) },
- { .display = {BLANK, BLANK, ONE,   NINE},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(190) },
- { .display = {BLANK, BLANK, TWO,   ZERO},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(200) },
- { .display = {BLANK, BLANK, TWO,   FOUR},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(240) },
- { .display = {BLANK, BLANK, TWO,   SIX},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(260) },
- { .display = {BLANK, BLANK, TWO,   SEVEN}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(270) },
- { .display = {BLANK, BLANK, TWO,   EIGHT}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(280) },
- { .display = {BLANK, BLANK, THREE, TWO},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(320) },
- { .display = {BLANK, BLANK, THREE, SIX},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(360) },
- { .display = {BLANK, BLANK, FOUR,  ZERO},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(400) },
- { .display = {BLANK, BLANK, FOUR,  FOUR},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(440) },
- { .display = {BLANK, BLANK, FOUR,  EIGHT}, .leds = LED_THREAD | LED_TPI, TPI_FRACTION(480) },
- { .display = {BLANK, BLANK, FIVE,  SIX},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(560) },
- { .display = {BLANK, BLANK, SIX,   FOUR},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(640) },
- { .display = {BLANK, BLANK, SEVEN, TWO},   .leds = LED_THREAD | LED_TPI, TPI_FRACTION(720) },
- { .display = {BLANK, BLANK, EIGHT, ZERO},  .leds = LED_THREAD | LED_TPI, TPI_FRACTION(800) },
+ INCH_THREAD(80),
+ INCH_THREAD(90),
+ INCH_THREAD(100),
+ INCH_THREAD(110),
+ INCH_THREAD(115),
+ INCH_THREAD(120),
+ INCH_THREAD(130),
+ INCH_THREAD(140),
+ INCH_THREAD(160),
+ INCH_THREAD(180),
+ INCH_THREAD(190),
+ INCH_THREAD(200),
+ INCH_THREAD(240),
+ INCH_THREAD(260),
+ INCH_THREAD(270),
+ INCH_THREAD(280),
+ INCH_THREAD(320),
+ INCH_THREAD(360),
+ INCH_THREAD(400),
+ INCH_THREAD(440),
+ INCH_THREAD(480),
+ INCH_THREAD(560),
+ INCH_THREAD(640),
+ INCH_THREAD(720),
+ INCH_THREAD(800),
 };
 
 
@@ -82,38 +104,42 @@ const FEED_THREAD inch_thread_table[] =
 //
 
 #if defined(LEADSCREW_TPI)
-#define THOU_IN_NUMERATOR(thou) ((Uint64)thou*LEADSCREW_TPI*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED)
-#define THOU_IN_DENOMINATOR(thou) ((Uint64)ENCODER_RESOLUTION*1000)
+#define THOU_IN_NUMERATOR(thou) ((Uint64)thou*LEADSCREW_TPI*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED*SPINDLE_COUNTS_DENOMINATOR)
+#define THOU_IN_DENOMINATOR(thou) (SPINDLE_COUNTS_NUMERATOR*1000)
 #endif
 #if defined(LEADSCREW_HMM)
-#define THOU_IN_NUMERATOR(thou) ((Uint64)thou*254*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED)
-#define THOU_IN_DENOMINATOR(thou) ((Uint64)ENCODER_RESOLUTION*100*LEADSCREW_HMM)
+#define THOU_IN_NUMERATOR(thou) ((Uint64)thou*254*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED*SPINDLE_COUNTS_DENOMINATOR)
+#define THOU_IN_DENOMINATOR(thou) (SPINDLE_COUNTS_NUMERATOR*100*LEADSCREW_HMM)
 #endif
 #define THOU_IN_FRACTION(thou) .numerator = THOU_IN_NUMERATOR(thou), .denominator = THOU_IN_DENOMINATOR(thou)
 
+// Thousandths as .ddd
+#define INCH_FEED_DISPLAY(thou) POINT, PLACE_DIGIT(thou, 100), PLACE_DIGIT(thou, 10), PLACE_DIGIT(thou, 1)
+#define INCH_FEED(thou) { .display = { INCH_FEED_DISPLAY(thou) }, .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(thou) }
+
 const FEED_THREAD inch_feed_table[] =
 {
- { .display = {POINT, ZERO, ZERO,  ONE},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(1) },
- { .display = {POINT, ZERO, ZERO,  TWO},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(2) },
- { .display = {POINT, ZERO, ZERO,  THREE},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(3) },
- { .display = {POINT, ZERO, ZERO,  FOUR},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(4) },
- { .display = {POINT, ZERO, ZERO,  FIVE},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(5) },
- { .display = {POINT, ZERO, ZERO,  SIX},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(6) },
- { .display = {POINT, ZERO, ZERO,  SEVEN},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(7) },
- { .display = {POINT, ZERO, ZERO,  EIGHT},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(8) },
- { .display = {POINT, ZERO, ZERO,  NINE},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(9) },
- { .display = {POINT, ZERO, ONE,   ZERO},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(10) },
- { .display = {POINT, ZERO, ONE,   ONE},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(11) },
- { .display = {POINT, ZERO, ONE,   TWO},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(12) },
- { .display = {POINT, ZERO, ONE,   THREE},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(13) },
- { .display = {POINT, ZERO, ONE,   FIVE},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(15) },
- { .display = {POINT, ZERO, ONE,   SEVEN},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(17) },
- { .display = {POINT, ZERO, TWO,   ZERO},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(20) },
- { .display = {POINT, ZERO, TWO,   THREE},  .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(23) },
- { .display = {POINT, ZERO, TWO,   SIX},    .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(26) },
- { .display = {POINT, ZERO, THREE, ZERO},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(30) },
- { .display = {POINT, ZERO, THREE, FIVE},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(35) },
- { .display = {POINT, ZERO, FOUR,  ZERO},   .leds = LED_FEED | LED_INCH, THOU_IN_FRACTION(40) },
+ INCH_FEED(1),
+ INCH_FEED(2),
+ INCH_FEED(3),
+ INCH_FEED(4),
+ INCH_FEED(5),
+ INCH_FEED(6),
+ INCH_FEED(7),
+ INCH_FEED(8),
+ INCH_FEED(9),
+ INCH_FEED(10),
+ INCH_FEED(11),
+ INCH_FEED(12),
+ INCH_FEED(13),
+ INCH_FEED(15),
+ INCH_FEED(17),
+ INCH_FEED(20),
+ INCH_FEED(23),
+ INCH_FEED(26),
+ INCH_FEED(30),
+ INCH_FEED(35),
+ INCH_FEED(40),
 };
 
 
@@ -126,41 +152,49 @@ const FEED_THREAD inch_feed_table[] =
 // LED indicator states and gear ratio fraction to use.
 //
 #if defined(LEADSCREW_TPI)
-#define HMM_NUMERATOR(hmm) ((Uint64)hmm*10*LEADSCREW_TPI*STEPPER_RESOLUTION*STEPPER_MICROSTEPS)
-#define HMM_DENOMINATOR(hmm) ((Uint64)ENCODER_RESOLUTION*254*100)
+#define HMM_NUMERATOR(hmm) ((Uint64)hmm*10*LEADSCREW_TPI*STEPPER_RESOLUTION*STEPPER_MICROSTEPS*SPINDLE_COUNTS_DENOMINATOR)
+#define HMM_DENOMINATOR(hmm) (SPINDLE_COUNTS_NUMERATOR*254*100)
 #endif
 #if defined(LEADSCREW_HMM)
-#define HMM_NUMERATOR(hmm) ((Uint64)hmm*STEPPER_RESOLUTION*STEPPER_MICROSTEPS)
-#define HMM_DENOMINATOR(hmm) ((Uint64)ENCODER_RESOLUTION*LEADSCREW_HMM)
+#define HMM_NUMERATOR(hmm) ((Uint64)hmm*STEPPER_RESOLUTION*STEPPER_MICROSTEPS*SPINDLE_COUNTS_DENOMINATOR)
+#define HMM_DENOMINATOR(hmm) (SPINDLE_COUNTS_NUMERATOR*LEADSCREW_HMM)
 #endif
 #define HMM_FRACTION(hmm) .numerator = HMM_NUMERATOR(hmm), .denominator = HMM_DENOMINATOR(hmm)
 
+// Pitch in millimeters, left-aligned, without trailing zeros
+#define METRIC_THREAD_DISPLAY(hmm) \
+    ((hmm) >= 1000 ? PLACE_DIGIT(hmm, 1000) : BLANK), \
+    (((hmm) >= 100 ? PLACE_DIGIT(hmm, 100) : BLANK) | ((hmm) % 100 != 0 ? POINT : BLANK)), \
+    ((hmm) % 100 != 0 ? PLACE_DIGIT(hmm, 10) : BLANK), \
+    ((hmm) % 10 != 0 ? PLACE_DIGIT(hmm, 1) : BLANK)
+#define METRIC_THREAD(hmm) { .display = { METRIC_THREAD_DISPLAY(hmm) }, .leds = LED_THREAD | LED_MM, HMM_FRACTION(hmm) }
+
 const FEED_THREAD metric_thread_table[] =
 {
- { .display = {BLANK, POINT,         TWO,   BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(20) },
- { .display = {BLANK, POINT,         TWO,   FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(25) },
- { .display = {BLANK, POINT,         THREE, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(30) },
- { .display = {BLANK, POINT,         THREE, FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(35) },
- { .display = {BLANK, POINT,         FOUR,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(40) },
- { .display = {BLANK, POINT,         FOUR,  FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(45) },
- { .display = {BLANK, POINT,         FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(50) },
- { .display = {BLANK, POINT,         SIX,   BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(60) },
- { .display = {BLANK, POINT,         SEVEN, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(70) },
- { .display = {BLANK, POINT,         SEVEN, FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(75) },
- { .display = {BLANK, POINT,         EIGHT, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(80) },
- { .display = {BLANK, ONE,           BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(100) },
- { .display = {BLANK, ONE | POINT,   TWO,   FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(125) },
- { .display = {BLANK, ONE | POINT,   FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(150) },
- { .display = {BLANK, ONE | POINT,   SEVEN, FIVE},  .leds = LED_THREAD | LED_MM, HMM_FRACTION(175) },
- { .display = {BLANK, TWO,           BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(200) },
- { .display = {BLANK, TWO | POINT,   FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(250) },
- { .display = {BLANK, THREE,         BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(300) },
- { .display = {BLANK, THREE | POINT, FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(350) },
- { .display = {BLANK, FOUR,          BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(400) },
- { .display = {BLANK, FOUR | POINT,  FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(450) },
- { .display = {BLANK, FIVE,          BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(500) },
- { .display = {BLANK, FIVE | POINT,  FIVE,  BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(550) },
- { .display = {BLANK, SIX,           BLANK, BLANK}, .leds = LED_THREAD | LED_MM, HMM_FRACTION(600) },
+ METRIC_THREAD(20),
+ METRIC_THREAD(25),
+ METRIC_THREAD(30),
+ METRIC_THREAD(35),
+ METRIC_THREAD(40),
+ METRIC_THREAD(45),
+ METRIC_THREAD(50),
+ METRIC_THREAD(60),
+ METRIC_THREAD(70),
+ METRIC_THREAD(75),
+ METRIC_THREAD(80),
+ METRIC_THREAD(100),
+ METRIC_THREAD(125),
+ METRIC_THREAD(150),
+ METRIC_THREAD(175),
+ METRIC_THREAD(200),
+ METRIC_THREAD(250),
+ METRIC_THREAD(300),
+ METRIC_THREAD(350),
+ METRIC_THREAD(400),
+ METRIC_THREAD(450),
+ METRIC_THREAD(500),
+ METRIC_THREAD(550),
+ METRIC_THREAD(600),
 };
 
 
@@ -172,38 +206,45 @@ const FEED_THREAD metric_thread_table[] =
 // LED indicator states and gear ratio fraction to use.
 //
 #if defined(LEADSCREW_TPI)
-#define HMM_NUMERATOR_FEED(hmm) ((Uint64)hmm*10*LEADSCREW_TPI*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED)
-#define HMM_DENOMINATOR_FEED(hmm) ((Uint64)ENCODER_RESOLUTION*254*100)
+#define HMM_NUMERATOR_FEED(hmm) ((Uint64)hmm*10*LEADSCREW_TPI*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED*SPINDLE_COUNTS_DENOMINATOR)
+#define HMM_DENOMINATOR_FEED(hmm) (SPINDLE_COUNTS_NUMERATOR*254*100)
 #endif
 #if defined(LEADSCREW_HMM)
-#define HMM_NUMERATOR_FEED(hmm) ((Uint64)hmm*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED)
-#define HMM_DENOMINATOR_FEED(hmm) ((Uint64)ENCODER_RESOLUTION*LEADSCREW_HMM)
+#define HMM_NUMERATOR_FEED(hmm) ((Uint64)hmm*STEPPER_RESOLUTION_FEED*STEPPER_MICROSTEPS_FEED*SPINDLE_COUNTS_DENOMINATOR)
+#define HMM_DENOMINATOR_FEED(hmm) (SPINDLE_COUNTS_NUMERATOR*LEADSCREW_HMM)
 #endif
 #define HMM_FRACTION_FEED(hmm) .numerator = HMM_NUMERATOR_FEED(hmm), .denominator = HMM_DENOMINATOR_FEED(hmm)
 
+// Millimeters as d.dd
+#define METRIC_FEED_DISPLAY(hmm) \
+    ((hmm) >= 1000 ? PLACE_DIGIT(hmm, 1000) : BLANK), \
+    (((hmm) >= 100 ? PLACE_DIGIT(hmm, 100) : BLANK) | POINT), \
+    PLACE_DIGIT(hmm, 10), PLACE_DIGIT(hmm, 1)
+#define METRIC_FEED(hmm) { .display = { METRIC_FEED_DISPLAY(hmm) }, .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(hmm) }
+
 const FEED_THREAD metric_feed_table[] =
 {
- { .display = {BLANK, POINT,       ZERO,  TWO},   .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(2) },
- { .display = {BLANK, POINT,       ZERO,  FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(5) },
- { .display = {BLANK, POINT,       ZERO,  SEVEN}, .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(7) },
- { .display = {BLANK, POINT,       ONE,   ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(10) },
- { .display = {BLANK, POINT,       ONE,   TWO},   .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(12) },
- { .display = {BLANK, POINT,       ONE,   FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(15) },
- { .display = {BLANK, POINT,       ONE,   SEVEN}, .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(17) },
- { .display = {BLANK, POINT,       TWO,   ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(20) },
- { .display = {BLANK, POINT,       TWO,   TWO},   .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(22) },
- { .display = {BLANK, POINT,       TWO,   FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(25) },
- { .display = {BLANK, POINT,       TWO,   SEVEN}, .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(27) },
- { .display = {BLANK, POINT,       THREE, ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(30) },
- { .display = {BLANK, POINT,       THREE, FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(35) },
- { .display = {BLANK, POINT,       FOUR,  ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(40) },
- { .display = {BLANK, POINT,       FOUR,  FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(45) },
- { .display = {BLANK, POINT,       FIVE,  ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(50) },
- { .display = {BLANK, POINT,       FIVE,  FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(55) },
- { .display = {BLANK, POINT,       SIX,   ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(60) },
- { .display = {BLANK, POINT,       SEVEN, ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(70) },
- { .display = {BLANK, POINT,       EIGHT, FIVE},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(85) },
- { .display = {BLANK, ONE | POINT, ZERO,  ZERO},  .leds = LED_FEED | LED_MM, HMM_FRACTION_FEED(100) },
+ METRIC_FEED(2),
+ METRIC_FEED(5),
+ METRIC_FEED(7),
+ METRIC_FEED(10),
+ METRIC_FEED(12),
+ METRIC_FEED(15),
+ METRIC_FEED(17),
+ METRIC_FEED(20),
+ METRIC_FEED(22),
+ METRIC_FEED(25),
+ METRIC_FEED(27),
+ METRIC_FEED(30),
+ METRIC_FEED(35),
+ METRIC_FEED(40),
+ METRIC_FEED(45),
+ METRIC_FEED(50),
+ METRIC_FEED(55),
+ METRIC_FEED(60),
+ METRIC_FEED(70),
+ METRIC_FEED(85),
+ METRIC_FEED(100),
 };
 
 
@@ -240,12 +281,123 @@ const FEED_THREAD *FeedTable :: previous(void)
     return this->current();
 }
 
+//
+// CUSTOM VALUES
+//
+// Values typed in on the control panel are four digits in the same units as the
+// tables above:
+//
+//   inch threads    ddd.d TPI   (tenths of a thread per inch)
+//   inch feeds      d.ddd in    (thousandths of an inch)
+//   metric threads  dd.dd mm    (hundredths of a millimeter)
+//   metric feeds    dd.dd mm    (hundredths of a millimeter)
+//
+#define CUSTOM_POINT_INCH_THREAD 2
+#define CUSTOM_POINT_INCH_FEED 0
+#define CUSTOM_POINT_METRIC 1
+
+
+static Uint64 greatestCommonDivisor(Uint64 a, Uint64 b)
+{
+    while( b != 0 )
+    {
+        Uint64 remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+static long double ratioError(long double value, Uint64 numerator, Uint64 denominator)
+{
+    long double error = value - (long double)numerator / denominator;
+    return (error < 0) ? -error : error;
+}
+
+//
+// Reduce numerator/denominator to lowest terms.  If either term is still larger
+// than maxTerm, replace the ratio with the closest fraction p/q whose terms both
+// fit, found by walking the continued fraction expansion and trying the last
+// semiconvergent before the limit.  The ratio always lies between p/q and the
+// neighboring candidate p'/q', and the two differ by exactly 1/(q*q'), so the
+// error is below 1/(q*q').
+//
+void reduceRatio(Uint64 *numerator, Uint64 *denominator, Uint64 maxTerm)
+{
+    Uint64 n = *numerator;
+    Uint64 d = *denominator;
+    Uint64 divisor = greatestCommonDivisor(n, d);
+
+    if( divisor == 0 ) return;
+
+    n /= divisor;
+    d /= divisor;
+
+    if( n <= maxTerm && d <= maxTerm )
+    {
+        *numerator = n;
+        *denominator = d;
+        return;
+    }
+
+    long double value = (long double)n / d;
+
+    // last two convergents, seeded with 0/1 and 1/0
+    Uint64 p0 = 0, q0 = 1;
+    Uint64 p1 = 1, q1 = 0;
+
+    while( d != 0 )
+    {
+        Uint64 a = n / d;
+
+        // largest partial quotient that keeps both terms in range
+        Uint64 k = a;
+        if( p1 != 0 && (maxTerm - p0) / p1 < k ) k = (maxTerm - p0) / p1;
+        if( q1 != 0 && (maxTerm - q0) / q1 < k ) k = (maxTerm - q0) / q1;
+
+        if( k < a )
+        {
+            // out of room: the best fit is either the last convergent or the
+            // semiconvergent just before the limit
+            if( k > 0 )
+            {
+                Uint64 p = k * p1 + p0;
+                Uint64 q = k * q1 + q0;
+                if( q1 == 0 || ratioError(value, p, q) < ratioError(value, p1, q1) )
+                {
+                    p1 = p;
+                    q1 = q;
+                }
+            }
+            break;
+        }
+
+        Uint64 p = a * p1 + p0;
+        Uint64 q = a * q1 + q0;
+        p0 = p1;
+        q0 = q1;
+        p1 = p;
+        q1 = q;
+
+        Uint64 remainder = n - a * d;
+        n = d;
+        d = remainder;
+    }
+
+    *numerator = p1;
+    *denominator = q1;
+}
+
+
+
 FeedTableFactory::FeedTableFactory(void):
         inchThreads(inch_thread_table, sizeof(inch_thread_table)/sizeof(inch_thread_table[0]), 12),
         inchFeeds(inch_feed_table, sizeof(inch_feed_table)/sizeof(inch_feed_table[0]), 4),
         metricThreads(metric_thread_table, sizeof(metric_thread_table)/sizeof(metric_thread_table[0]), 6),
         metricFeeds(metric_feed_table, sizeof(metric_feed_table)/sizeof(metric_feed_table[0]), 4)
 {
+    this->customIndex = 0;
+    this->taperIndex = 0;
 }
 
 FeedTable *FeedTableFactory::getFeedTable(bool metric, bool thread)
@@ -274,3 +426,82 @@ FeedTable *FeedTableFactory::getFeedTable(bool metric, bool thread)
     }
 
 }
+
+const FEED_THREAD *FeedTableFactory::getCustomFeed(bool metric, bool thread, Uint16 value)
+{
+    // fill in the buffer the core isn't using
+    this->customIndex ^= 1;
+    FEED_THREAD *feed = &this->custom[this->customIndex];
+
+    formatValue(feed->display, value, getCustomPoint(metric, thread));
+
+    if( metric )
+    {
+        if( thread )
+        {
+            feed->leds.all = LED_THREAD | LED_MM;
+            feed->numerator = HMM_NUMERATOR(value);
+            feed->denominator = HMM_DENOMINATOR(value);
+        }
+        else
+        {
+            feed->leds.all = LED_FEED | LED_MM;
+            feed->numerator = HMM_NUMERATOR_FEED(value);
+            feed->denominator = HMM_DENOMINATOR_FEED(value);
+        }
+    }
+    else
+    {
+        if( thread )
+        {
+            feed->leds.all = LED_THREAD | LED_TPI;
+            feed->numerator = TPI_NUMERATOR(value);
+            feed->denominator = TPI_DENOMINATOR(value);
+        }
+        else
+        {
+            feed->leds.all = LED_FEED | LED_INCH;
+            feed->numerator = THOU_IN_NUMERATOR(value);
+            feed->denominator = THOU_IN_DENOMINATOR(value);
+        }
+    }
+
+    reduceRatio(&feed->numerator, &feed->denominator, FEED_THREAD_MAX_TERM);
+
+    return feed;
+}
+
+const FEED_THREAD *FeedTableFactory::getTaperFeed(const FEED_THREAD *feed, Uint16 taper)
+{
+    if( taper == 0 )
+    {
+        return NULL;
+    }
+
+    // fill in the buffer the core isn't using
+    this->taperIndex ^= 1;
+    FEED_THREAD *cross = &this->taper[this->taperIndex];
+
+    // cross-slide steps per encoder count: the leadscrew's, times the taper,
+    // times the cross-slide steps for the same distance
+    *cross = *feed;
+    cross->numerator = feed->numerator * taper * CROSS_SLIDE_STEPS_NUMERATOR;
+    cross->denominator = feed->denominator * TAPER_SCALE * CROSS_SLIDE_STEPS_DENOMINATOR;
+    reduceRatio(&cross->numerator, &cross->denominator, FEED_THREAD_MAX_TERM);
+
+    return cross;
+}
+
+Uint16 FeedTableFactory::getCustomPoint(bool metric, bool thread)
+{
+    if( metric )
+    {
+        return CUSTOM_POINT_METRIC;
+    }
+    return thread ? CUSTOM_POINT_INCH_THREAD : CUSTOM_POINT_INCH_FEED;
+}
+
+void FeedTableFactory::formatValue(Uint16 *display, Uint16 value, Uint16 point)
+{
+    renderNumber(display, 4, value, point >= NO_DECIMAL_POINT ? 0 : 3 - point);
+}
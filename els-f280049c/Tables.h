@@ -42,6 +42,33 @@ typedef struct FEED_THREAD
 } FEED_THREAD;
 
 
+//
+// Largest term allowed in a ratio built at run time.  Core multiplies a 24-bit
+// encoder count by the numerator in 64-bit signed arithmetic, so keeping both
+// terms below 2^39 rules out overflow.
+//
+#define FEED_THREAD_MAX_TERM (((Uint64)1 << 39) - 1)
+
+//
+// Largest value that can be typed in on the four-digit display
+//
+#define CUSTOM_VALUE_MAX 9999
+
+//
+// Decimal point position for formatValue() that puts no point on the display
+//
+#define NO_DECIMAL_POINT 4
+
+//
+// Tapers are cross-slide travel per unit of carriage travel, in thousandths
+//
+#define TAPER_SCALE 1000
+#define TAPER_MAX 999
+
+
+// Reduce a ratio to lowest terms, approximating it if it still won't fit
+void reduceRatio(Uint64 *numerator, Uint64 *denominator, Uint64 maxTerm);
+
 
 class FeedTable
 {
@@ -67,10 +94,31 @@ private:
     FeedTable metricThreads;
     FeedTable metricFeeds;
 
+    // custom feeds are double-buffered so the core never sees a half-written one
+    FEED_THREAD custom[2];
+    Uint16 customIndex;
+
+    // cross-slide ratios, double-buffered the same way
+    FEED_THREAD taper[2];
+    Uint16 taperIndex;
+
 public:
     FeedTableFactory(void);
 
     FeedTable *getFeedTable(bool metric, bool thread);
+
+    // build a feed or thread from a value typed in on the control panel
+    const FEED_THREAD *getCustomFeed(bool metric, bool thread, Uint16 value);
+
+    // cross-slide ratio that cuts a taper, in thousandths, while the leadscrew
+    // runs at feed; NULL for no taper
+    const FEED_THREAD *getTaperFeed(const FEED_THREAD *feed, Uint16 taper);
+
+    // digit that carries the decimal point for custom values in a mode
+    Uint16 getCustomPoint(bool metric, bool thread);
+
+    // render a custom value onto the four-digit display
+    void formatValue(Uint16 *display, Uint16 value, Uint16 point);
 };
 
 
@@ -28,49 +28,210 @@
 
 const MESSAGE STARTUP_MESSAGE_2 =
 {
-  .message = { LETTER_E, LETTER_L, LETTER_S, DASH, ONE | POINT, THREE | POINT, ZERO, ONE },
+  .text = "ELS-1.3.01",
   .displayTime = UI_REFRESH_RATE_HZ * 1.5
 };
 
 const MESSAGE STARTUP_MESSAGE_1 =
 {
- .message = { LETTER_C, LETTER_L, LETTER_O, LETTER_U, LETTER_G, LETTER_H, FOUR, TWO },
+ .text = "CLOUGH42",
  .displayTime = UI_REFRESH_RATE_HZ * 1.5,
  .next = &STARTUP_MESSAGE_2
 };
 
-const MESSAGE SETTINGS_MESSAGE_2 =
+const char ALARM_MESSAGE[] = " ALARM";
+
+const char RESUME_MESSAGE[] = " RESUME";
+
+#ifdef USE_LEADSCREW_ENCODER
+const char FEEDBACK_FAULT_MESSAGE[] = " FB ERR";
+#endif // USE_LEADSCREW_ENCODER
+
+const MESSAGE ENCODER_WARNING_MESSAGE =
+{
+ .text = " ENC ERR",
+ .displayTime = UI_REFRESH_RATE_HZ * 2
+};
+
+const MESSAGE CALIBRATION_DONE_MESSAGE =
 {
- .message = { LETTER_S, LETTER_E, LETTER_T, LETTER_T, LETTER_I, LETTER_N, LETTER_G, LETTER_S },
- .displayTime = UI_REFRESH_RATE_HZ * .5
+ .text = " CAL OK",
+ .displayTime = UI_REFRESH_RATE_HZ * 2
 };
 
-const MESSAGE SETTINGS_MESSAGE_1 =
+const MESSAGE CALIBRATION_FAILED_MESSAGE =
 {
- .message = { BLANK, BLANK, BLANK, LETTER_N, LETTER_O, BLANK, BLANK, BLANK },
- .displayTime = UI_REFRESH_RATE_HZ * .5,
- .next = &SETTINGS_MESSAGE_2
+ .text = " CAL ERR",
+ .displayTime = UI_REFRESH_RATE_HZ * 2
 };
 
 const Uint16 VALUE_BLANK[4] = { BLANK, BLANK, BLANK, BLANK };
 
-UserInterface :: UserInterface(ControlPanel *controlPanel, Core *core, FeedTableFactory *feedTableFactory)
+// Diagnostics pages, each a label of up to four letters and a value
+#define PAGE_PHASE_ERRORS 0
+#define PAGE_INDEX_ERRORS 1
+#define PAGE_INDEX_CORRECTION 2
+#define PAGE_RESOLUTION 3       // FWD/REV starts a measurement
+#define PAGE_ACCELERATION 4
+#define PAGE_SPEED_VARIATION 5
+#define PAGE_QUALIFICATION 6    // FWD/REV calibrates it
+#define PAGE_ISR_TIME 7
+#define PAGE_MAX_ISR_TIME 8     // FWD/REV resets it
+#define PAGE_LEADSCREW_CORRECTION 9
+#define PAGE_FOLLOWING_ERROR 10
+#define PAGE_WAKE_COUNT 11
+#define PAGE_WAKE_LATENCY 12
+#define PAGE_MAX_WAKE_LATENCY 13
+#define PAGE_STEP_JITTER 14     // FWD/REV resets it
+#define PAGE_TASK_OVERRUNS 15
+#define PAGE_TASKS_SKIPPED 16
+
+typedef struct DIAGNOSTIC_PAGE
+{
+    Uint16 page;
+    const char *label;
+} DIAGNOSTIC_PAGE;
+
+const DIAGNOSTIC_PAGE DIAGNOSTIC_PAGES[] =
+{
+ { PAGE_PHASE_ERRORS, "PHSE" },     // encoder phase errors
+ { PAGE_INDEX_ERRORS, "INDX" },     // encoder index errors
+#ifdef USE_INDEX_CORRECTION
+ { PAGE_INDEX_CORRECTION, "CORR" }, // counts corrected from the index
+#endif // USE_INDEX_CORRECTION
+#ifdef USE_LEADSCREW_ENCODER
+ { PAGE_LEADSCREW_CORRECTION, "LCOR" }, // leadscrew steps corrected from its encoder
+ { PAGE_FOLLOWING_ERROR, "FERR" },  // largest leadscrew following error, steps
+#endif // USE_LEADSCREW_ENCODER
+ { PAGE_RESOLUTION, "RES" },        // encoder counts per revolution
+ { PAGE_ACCELERATION, "ACCL" },     // spindle acceleration, RPM/s
+ { PAGE_SPEED_VARIATION, "VAR" },   // spindle speed spread over a revolution, RPM
+ { PAGE_QUALIFICATION, "QUAL" },    // encoder input qualification level
+ { PAGE_ISR_TIME, "ISR" },          // stepper interrupt time, last run, us
+ { PAGE_MAX_ISR_TIME, "ISRM" },     // stepper interrupt time, longest run, us
+ { PAGE_WAKE_COUNT, "WAKE" },       // wake-ups from the idle poll
+ { PAGE_WAKE_LATENCY, "WLAT" },     // first encoder edge to wake, last, us
+ { PAGE_MAX_WAKE_LATENCY, "WMAX" }, // first encoder edge to wake, longest, us
+ { PAGE_TASK_OVERRUNS, "OVR" },     // main loop task runs longer than their period
+ { PAGE_TASKS_SKIPPED, "SKIP" },    // main loop task runs dropped for falling behind
+#ifdef MEASURE_STEP_JITTER
+ { PAGE_STEP_JITTER, "JIT" },       // worst step edge delay at the current speed and feed, us
+#endif // MEASURE_STEP_JITTER
+};
+
+#define DIAGNOSTIC_PAGE_COUNT (sizeof(DIAGNOSTIC_PAGES) / sizeof(DIAGNOSTIC_PAGE))
+
+// Times are shown in hundredths of a microsecond
+#define CYCLES_TO_HUNDREDTHS_US(cycles) ((Uint32)(cycles) * 100 / CPU_CLOCK_MHZ)
+
+const char CALIBRATION_LABEL[] = "CAL";
+
+// Input qualification calibration steps, each shown with its glitch count
+#define QUALIFY_IDLE 0
+#define QUALIFY_NOISE 1     // spindle stopped; raise the filter until no noise gets through
+#define QUALIFY_WAIT 2      // waiting for the operator to start the spindle
+#define QUALIFY_RUN 3       // spindle running; back off the filter on any error
+
+#define QUALIFY_TIME (UI_REFRESH_RATE_HZ * ENCODER_QUALIFY_SECONDS)
+
+const char * const QUALIFY_LABELS[4] = { "QUAL", "NOIS", "SPIN", "RUN" };
+
+#ifdef USE_HANDWHEEL
+// Handwheel scales, in multiples of HANDWHEEL_STEPS_PER_DETENT
+#define JOG_SCALES 3
+
+const Uint16 JOG_SCALE[JOG_SCALES] = { 1, 10, 100 };
+
+const char JOG_LABEL[] = "JOG";
+
+// how long the jog view stays up after the handwheel stops, unless latched
+#define JOG_DISPLAY_TIME (UI_REFRESH_RATE_HZ * 3)
+#endif // USE_HANDWHEEL
+
+#ifdef USE_CROSS_SLIDE
+// Taper view; a minus sign after TAP shows the cross-slide moves the other way
+const char TAPER_LABEL[] = "TAP";
+const char TAPER_REVERSE_LABEL[] = "TAP-";
+#endif // USE_CROSS_SLIDE
+
+// Indexing view: spindle angle in tenths of a degree, or the division number in
+// hundredths so the operator can stop on x.00
+const char ANGLE_LABEL[] = "ANG";
+
+#define INDEX_DIVISIONS_DEFAULT 24
+#define INDEX_DIVISIONS_MAX 99
+
+const Uint16 EDIT_PLACES[4] = { 1000, 100, 10, 1 };
+
+// blink period for the digit being edited
+#define EDIT_BLINK_TIME (UI_REFRESH_RATE_HZ / 2)
+
+UserInterface :: UserInterface(ControlPanel *controlPanel, Core *core, Encoder *encoder, FeedTableFactory *feedTableFactory, Settings *settings, Debug *debug)
 {
     this->controlPanel = controlPanel;
     this->core = core;
+    this->encoder = encoder;
     this->feedTableFactory = feedTableFactory;
+    this->settings = settings;
+    this->debug = debug;
 
     this->metric = false; // start out with imperial
     this->thread = false; // start out with feeds
     this->reverse = false; // start out going forward
 
     this->feedTable = NULL;
+    this->customFeed = NULL;
+
+    this->editing = false;
+    this->editDigit = 0;
+    this->editValue = 0;
+    this->blinkTime = 0;
+
+    // starting points for numeric entry: .005 in, 11.5 TPI, .10 mm, .35 mm
+    this->customValues[0][0] = 5;
+    this->customValues[0][1] = 115;
+    this->customValues[1][0] = 10;
+    this->customValues[1][1] = 35;
+
+    this->diagnostics = false;
+    this->diagnosticPage = 0;
+    this->calibrating = false;
+    this->qualifyState = QUALIFY_IDLE;
+    this->qualifyTime = 0;
+    this->qualifyErrors = 0;
+    this->qualifyPrevious = 0;
+    this->qualifyFloor = 0;
+    this->qualifyCeiling = 0;
+    this->warnedErrors = 0;
+
+    this->indexing = false;
+    this->indexDivide = false;
+    this->indexDivisions = INDEX_DIVISIONS_DEFAULT;
+    this->indexPrevious = 0;
+    this->indexCounts = 0;
+
+#ifdef USE_HANDWHEEL
+    this->jogView = false;
+    this->jogLatched = false;
+    this->jogTime = 0;
+    this->jogScaleIndex = 0;
+    this->handwheelDetents = 0;
+#endif // USE_HANDWHEEL
+
+#ifdef USE_CROSS_SLIDE
+    this->taperView = false;
+    this->taper = 0;
+    this->taperReverse = false;
+#endif // USE_CROSS_SLIDE
 
     this->keys.all = 0xff;
+    this->longKeys.all = 0;
+
+    this->alarm = false;
 
     // initialize the core so we start up correctly
     core->setReverse(this->reverse);
-    core->setFeed(loadFeedTable());
+    applyFeed(loadFeedTable());
 
     setMessage(&STARTUP_MESSAGE_1);
 }
@@ -78,13 +239,32 @@ UserInterface :: UserInterface(ControlPanel *controlPanel, Core *core, FeedTable
 const FEED_THREAD *UserInterface::loadFeedTable()
 {
     this->feedTable = this->feedTableFactory->getFeedTable(this->metric, this->thread);
+    this->customFeed = NULL;
     return this->feedTable->current();
 }
 
+const FEED_THREAD *UserInterface::currentFeed()
+{
+    if( this->customFeed != NULL )
+    {
+        return this->customFeed;
+    }
+    return this->feedTable->current();
+}
+
+void UserInterface::applyFeed(const FEED_THREAD *feed)
+{
+    core->setFeed(feed);
+#ifdef USE_CROSS_SLIDE
+    // the cross-slide follows whatever the leadscrew does, at the taper ratio
+    core->setCrossSlideFeed(feedTableFactory->getTaperFeed(feed, this->taper), this->taperReverse);
+#endif // USE_CROSS_SLIDE
+}
+
 LED_REG UserInterface::calculateLEDs()
 {
     // get the LEDs for this feed
-    LED_REG leds = feedTable->current()->leds;
+    LED_REG leds = currentFeed()->leds;
 
     if( this->core->isPowerOn() )
     {
@@ -108,13 +288,19 @@ void UserInterface :: setMessage(const MESSAGE *message)
     this->messageTime = message->displayTime;
 }
 
+void UserInterface :: showText(const char *text)
+{
+    renderText(this->messageDisplay, 8, text);
+    controlPanel->setMessage(this->messageDisplay);
+}
+
 void UserInterface :: overrideMessage( void )
 {
     if( this->message != NULL )
     {
         if( this->messageTime > 0 ) {
             this->messageTime--;
-            controlPanel->setMessage(this->message->message);
+            showText(this->message->text);
         }
         else {
             this->message = this->message->next;
@@ -126,16 +312,642 @@ void UserInterface :: overrideMessage( void )
     }
 }
 
+bool UserInterface :: handleAlarm( Uint16 currentRpm )
+{
+    if( this->core->isAlarmLatched() )
+    {
+        // the drive is frozen; show the fault until the operator clears it
+        this->alarm = true;
+
+        if( this->core->isAlarm() )
+        {
+            showText(ALARM_MESSAGE);
+        }
+        else
+        {
+            // drive alarm is gone; resume sync when the operator says so, but
+            // only with the spindle stopped so the move back to the preserved
+            // position is made at rest
+            const char *text = RESUME_MESSAGE;
+#ifdef USE_LEADSCREW_ENCODER
+            if( this->core->isFeedbackFault() )
+            {
+                // lost steps rather than a drive alarm; SET still resumes
+                text = FEEDBACK_FAULT_MESSAGE;
+            }
+#endif // USE_LEADSCREW_ENCODER
+            showText(text);
+
+            if( keys.bit.SET && currentRpm == 0 )
+            {
+                this->core->clearAlarm();
+            }
+        }
+        return true;
+    }
+
+    if( this->alarm )
+    {
+        // just resumed; drop the alarm display
+        this->alarm = false;
+        controlPanel->setMessage(NULL);
+    }
+    return false;
+}
+
+void UserInterface :: startEdit( void )
+{
+    this->editing = true;
+    this->editDigit = 0;
+    this->editValue = this->customValues[this->metric][this->thread];
+    this->blinkTime = 0;
+}
+
+bool UserInterface :: handleEdit( void )
+{
+    if( ! this->editing )
+    {
+        return false;
+    }
+
+    Uint16 place = EDIT_PLACES[this->editDigit];
+    Uint16 digit = (this->editValue / place) % 10;
+
+    // digits roll over without carrying into their neighbors
+    if( keys.bit.UP )
+    {
+        if( digit == 9 ) this->editValue -= 9 * place;
+        else this->editValue += place;
+        this->blinkTime = 0;
+    }
+    if( keys.bit.DOWN )
+    {
+        if( digit == 0 ) this->editValue += 9 * place;
+        else this->editValue -= place;
+        this->blinkTime = 0;
+    }
+    if( keys.bit.POWER )
+    {
+        // abandon the entry
+        this->editing = false;
+    }
+    if( keys.bit.SET )
+    {
+        if( this->editDigit < 3 )
+        {
+            this->editDigit++;
+            this->blinkTime = 0;
+        }
+        else
+        {
+            // last digit: a zero value can't be cut, so treat it as a cancel
+            this->editing = false;
+            if( this->editValue > 0 )
+            {
+                this->customValues[this->metric][this->thread] = this->editValue;
+                this->customFeed = feedTableFactory->getCustomFeed(this->metric, this->thread, this->editValue);
+                applyFeed(this->customFeed);
+            }
+        }
+    }
+
+    if( ++this->blinkTime >= EDIT_BLINK_TIME )
+    {
+        this->blinkTime = 0;
+    }
+
+    return this->editing;
+}
+
+int32 UserInterface :: diagnosticValue( Uint16 page )
+{
+    switch( page )
+    {
+    case PAGE_PHASE_ERRORS:
+        return encoder->getPhaseErrors();
+    case PAGE_INDEX_ERRORS:
+        return encoder->getIndexErrors();
+#ifdef USE_INDEX_CORRECTION
+    case PAGE_INDEX_CORRECTION:
+        return encoder->getCorrectedCounts();
+#endif // USE_INDEX_CORRECTION
+    case PAGE_RESOLUTION:
+        return encoder->getResolution();
+    case PAGE_ACCELERATION:
+        return encoder->getAcceleration();
+    case PAGE_SPEED_VARIATION:
+        return encoder->getSpeedVariation();
+    case PAGE_QUALIFICATION:
+        return encoder->getQualification();
+#ifdef USE_LEADSCREW_ENCODER
+    case PAGE_LEADSCREW_CORRECTION:
+        return core->getCorrectionSteps();
+    case PAGE_FOLLOWING_ERROR:
+        return core->getMaxFollowingError();
+#endif // USE_LEADSCREW_ENCODER
+    case PAGE_ISR_TIME:
+        return CYCLES_TO_HUNDREDTHS_US(debug->getIsrCycles());
+    case PAGE_MAX_ISR_TIME:
+        return CYCLES_TO_HUNDREDTHS_US(debug->getMaxIsrCycles());
+    case PAGE_WAKE_COUNT:
+        return core->getWakeCount();
+    case PAGE_WAKE_LATENCY:
+        return core->getWakeLatencyUs();
+    case PAGE_MAX_WAKE_LATENCY:
+        return core->getMaxWakeLatencyUs();
+    case PAGE_TASK_OVERRUNS:
+        return debug->getTaskOverruns();
+    case PAGE_TASKS_SKIPPED:
+        return debug->getTaskSkipped();
+#ifdef MEASURE_STEP_JITTER
+    case PAGE_STEP_JITTER:
+        return CYCLES_TO_HUNDREDTHS_US(debug->getCurrentJitterStats()->maxCycles);
+#endif // MEASURE_STEP_JITTER
+    }
+    return 0;
+}
+
+bool UserInterface :: handleDiagnostics( void )
+{
+    if( ! this->diagnostics )
+    {
+        return false;
+    }
+
+    if( keys.bit.UP )
+    {
+        this->diagnosticPage = (this->diagnosticPage + 1) % DIAGNOSTIC_PAGE_COUNT;
+    }
+    if( keys.bit.DOWN )
+    {
+        this->diagnosticPage = (this->diagnosticPage + DIAGNOSTIC_PAGE_COUNT - 1) % DIAGNOSTIC_PAGE_COUNT;
+    }
+
+    const DIAGNOSTIC_PAGE *page = &DIAGNOSTIC_PAGES[this->diagnosticPage];
+
+    if( keys.bit.FWD_REV && page->page == PAGE_RESOLUTION )
+    {
+        // the spindle has to be run by hand for the measurement
+        encoder->startCalibration();
+        this->calibrating = true;
+    }
+    if( keys.bit.FWD_REV && page->page == PAGE_QUALIFICATION
+        && this->qualifyState == QUALIFY_IDLE && encoder->getRPM() == 0 )
+    {
+        startQualify();
+    }
+    if( keys.bit.FWD_REV && page->page == PAGE_MAX_ISR_TIME )
+    {
+        debug->resetIsrTime();
+    }
+#ifdef MEASURE_STEP_JITTER
+    if( keys.bit.FWD_REV && page->page == PAGE_STEP_JITTER )
+    {
+        debug->resetJitter();
+    }
+#endif // MEASURE_STEP_JITTER
+    if( keys.bit.SET || keys.bit.POWER )
+    {
+        // leaving part way through puts the old qualification back
+        if( this->qualifyState != QUALIFY_IDLE )
+        {
+            stopQualify(false);
+        }
+        this->diagnostics = false;
+        controlPanel->setMessage(NULL);
+        return true;
+    }
+
+    const char *label = page->label;
+    int32 value = diagnosticValue(page->page);
+    Uint16 decimals = 0;
+    if( this->calibrating && page->page == PAGE_RESOLUTION )
+    {
+        // show progress instead
+        label = CALIBRATION_LABEL;
+        value = encoder->getCalibrationRevs();
+    }
+    if( this->qualifyState != QUALIFY_IDLE && page->page == PAGE_QUALIFICATION )
+    {
+        label = QUALIFY_LABELS[this->qualifyState];
+        value = qualifyCount();
+    }
+    if( page->page == PAGE_ISR_TIME || page->page == PAGE_MAX_ISR_TIME || page->page == PAGE_STEP_JITTER )
+    {
+        decimals = 2;
+    }
+
+    renderText(this->diagnosticDisplay, 4, label);
+    renderNumber(this->diagnosticDisplay + 4, 4, value, decimals);
+    controlPanel->setMessage(this->diagnosticDisplay);
+
+    return true;
+}
+
+#ifdef USE_HANDWHEEL
+bool UserInterface :: handleJog( void )
+{
+    // turning the handwheel brings up the jog view
+    Uint32 detents = core->getHandwheelDetents();
+    if( detents != this->handwheelDetents )
+    {
+        this->handwheelDetents = detents;
+        this->jogView = core->isPowerOn();
+        this->jogTime = 0;
+    }
+
+    if( ! this->jogView )
+    {
+        return false;
+    }
+
+    if( keys.bit.UP && this->jogScaleIndex < JOG_SCALES - 1 )
+    {
+        this->jogScaleIndex++;
+    }
+    if( keys.bit.DOWN && this->jogScaleIndex > 0 )
+    {
+        this->jogScaleIndex--;
+    }
+    if( keys.bit.SET )
+    {
+        // latched, the handwheel works with the spindle running too
+        this->jogLatched = ! this->jogLatched;
+    }
+    if( keys.bit.UP || keys.bit.DOWN || keys.bit.SET )
+    {
+        this->jogTime = 0;
+    }
+    core->setJogScale(JOG_SCALE[this->jogScaleIndex]);
+
+    if( keys.bit.POWER || (! this->jogLatched && ++this->jogTime >= JOG_DISPLAY_TIME) )
+    {
+        this->jogView = false;
+        this->jogLatched = false;
+        controlPanel->setMessage(NULL);
+        return true;
+    }
+
+    // a decimal point after JOG shows jog mode is latched
+    renderText(this->jogDisplay, 4, JOG_LABEL);
+    if( this->jogLatched )
+    {
+        this->jogDisplay[2] |= POINT;
+    }
+    renderNumber(this->jogDisplay + 4, 4, JOG_SCALE[this->jogScaleIndex], 0);
+    controlPanel->setMessage(this->jogDisplay);
+
+    return true;
+}
+#endif // USE_HANDWHEEL
+
+#ifdef USE_CROSS_SLIDE
+bool UserInterface :: handleTaper( void )
+{
+    if( ! this->taperView )
+    {
+        return false;
+    }
+
+    if( keys.bit.UP && this->taper < TAPER_MAX )
+    {
+        this->taper++;
+    }
+    if( keys.bit.DOWN && this->taper > 0 )
+    {
+        this->taper--;
+    }
+    if( keys.bit.FWD_REV )
+    {
+        this->taperReverse = ! this->taperReverse;
+    }
+    if( keys.bit.SET || keys.bit.IN_MM || keys.bit.POWER )
+    {
+        // takes effect from the current feed on
+        this->taperView = false;
+        applyFeed(currentFeed());
+        controlPanel->setMessage(NULL);
+        return true;
+    }
+
+    renderText(this->taperDisplay, 4, this->taperReverse ? TAPER_REVERSE_LABEL : TAPER_LABEL);
+    renderNumber(this->taperDisplay + 4, 4, this->taper, 3);
+    controlPanel->setMessage(this->taperDisplay);
+
+    return true;
+}
+#endif // USE_CROSS_SLIDE
+
+Uint32 UserInterface :: spindleCount( void )
+{
+    // the same position Core syncs to, including any index correction
+    Uint32 count = encoder->getPosition();
+#ifdef USE_INDEX_CORRECTION
+    count += core->getSpindleOffset();
+#endif // USE_INDEX_CORRECTION
+    return count & _ENCODER_MAX_COUNT;
+}
+
+void UserInterface :: startIndexing( void )
+{
+    // zero is wherever the spindle is now
+    this->indexing = true;
+    this->indexPrevious = spindleCount();
+    this->indexCounts = 0;
+}
+
+bool UserInterface :: handleIndexing( void )
+{
+    if( ! this->indexing )
+    {
+        return false;
+    }
+
+    if( keys.bit.FEED_THREAD || keys.bit.POWER )
+    {
+        this->indexing = false;
+        controlPanel->setMessage(NULL);
+        return true;
+    }
+    if( longKeys.bit.SET )
+    {
+        // re-zeroing takes a long press, so a stray tap can't lose the reference
+        startIndexing();
+    }
+    if( keys.bit.FWD_REV )
+    {
+        this->indexDivide = ! this->indexDivide;
+    }
+    if( keys.bit.UP && this->indexDivisions < INDEX_DIVISIONS_MAX )
+    {
+        this->indexDivisions++;
+    }
+    if( keys.bit.DOWN && this->indexDivisions > 2 )
+    {
+        this->indexDivisions--;
+    }
+
+    // extend the 24-bit count, keeping it within one full cycle of the
+    // encoder gearing: ENCODER_GEAR_DENOMINATOR spindle turns.  At UI rate the
+    // spindle can't turn anywhere near half the count range between reads.
+    Uint32 cycle = (Uint32)encoder->getResolution() * ENCODER_GEAR_NUMERATOR;
+    Uint32 current = spindleCount();
+    int32 delta = ((int32)((current - this->indexPrevious) << 8)) >> 8;
+    this->indexPrevious = current;
+
+    int32 counts = ((int32)this->indexCounts + delta) % (int32)cycle;
+    if( counts < 0 ) {
+        counts += cycle;
+    }
+    this->indexCounts = counts;
+
+    // position within the spindle turn, rounded to the nearest display step
+    Uint32 steps = this->indexDivide ? (Uint32)this->indexDivisions * 100 : 3600;
+    Uint32 value = ((Uint64)this->indexCounts * steps * ENCODER_GEAR_DENOMINATOR + cycle / 2) / cycle % steps;
+
+    if( this->indexDivide )
+    {
+        renderNumber(this->indexDisplay, 4, this->indexDivisions, 0);
+        this->indexDisplay[0] = LETTER_D;
+        renderNumber(this->indexDisplay + 4, 4, value, 2);
+    }
+    else
+    {
+        renderText(this->indexDisplay, 4, ANGLE_LABEL);
+        renderNumber(this->indexDisplay + 4, 4, value, 1);
+    }
+    controlPanel->setMessage(this->indexDisplay);
+
+    return true;
+}
+
+void UserInterface :: checkEncoder( void )
+{
+    // warn each time another batch of encoder errors piles up, so a noisy
+    // cable gets noticed before it ruins a thread
+    Uint32 errors = encoder->getErrorCount();
+    if( errors - this->warnedErrors >= ENCODER_ERROR_WARNING )
+    {
+        this->warnedErrors = errors;
+        setMessage(&ENCODER_WARNING_MESSAGE);
+    }
+}
+
+void UserInterface :: checkCalibration( void )
+{
+    if( ! this->calibrating || encoder->isCalibrating() )
+    {
+        return;
+    }
+    this->calibrating = false;
+
+    Uint16 resolution = encoder->getCalibratedResolution();
+    if( resolution == 0 )
+    {
+        setMessage(&CALIBRATION_FAILED_MESSAGE);
+    }
+    else
+    {
+        // keep it for next time, and start using it now
+        settings->setEncoderResolution(resolution);
+        core->setEncoderResolution(resolution);
+        setMessage(&CALIBRATION_DONE_MESSAGE);
+    }
+
+    // get out of the way so the result can be seen
+    this->diagnostics = false;
+}
+
+void UserInterface :: startQualify( void )
+{
+    // the filter can't be stronger than ENCODER_MAX_RPM allows; start with none
+    // at all and see how noisy the lines are
+    this->qualifyPrevious = encoder->getQualification();
+    this->qualifyCeiling = encoder->strongestQualification(ENCODER_MAX_RPM);
+    encoder->setQualification(0);
+    encoder->countGlitches(true);
+
+    this->qualifyState = QUALIFY_NOISE;
+    this->qualifyTime = 0;
+    this->qualifyErrors = encoder->getErrorCount();
+}
+
+void UserInterface :: stopQualify( bool keep )
+{
+    encoder->countGlitches(false);
+    this->qualifyState = QUALIFY_IDLE;
+
+    if( keep )
+    {
+        settings->setInputQualification(encoder->getQualification());
+    }
+    else
+    {
+        encoder->setQualification(this->qualifyPrevious);
+    }
+}
+
+void UserInterface :: failQualify( void )
+{
+    stopQualify(false);
+    setMessage(&CALIBRATION_FAILED_MESSAGE);
+    this->diagnostics = false;
+}
+
+Uint32 UserInterface :: qualifyCount( void )
+{
+    // glitches plus any phase or index errors since the step began
+    return encoder->getGlitches() + encoder->getErrorCount() - this->qualifyErrors;
+}
+
+void UserInterface :: checkQualify( Uint16 currentRpm )
+{
+    if( this->qualifyState == QUALIFY_IDLE )
+    {
+        return;
+    }
+
+    bool restart = false;
+
+    switch( this->qualifyState )
+    {
+    case QUALIFY_NOISE:
+        if( qualifyCount() > 0 )
+        {
+            if( encoder->getQualification() >= this->qualifyCeiling )
+            {
+                // no filter that passes the top speed keeps the noise out
+                failQualify();
+                return;
+            }
+            encoder->setQualification(encoder->getQualification() + 1);
+            restart = true;
+        }
+        else if( ++this->qualifyTime >= QUALIFY_TIME )
+        {
+            // this is the least filtering that will do; running starts from
+            // the strongest and backs off no further than this
+            this->qualifyFloor = encoder->getQualification();
+            encoder->setQualification(this->qualifyCeiling);
+            this->qualifyState = QUALIFY_WAIT;
+            restart = true;
+        }
+        break;
+
+    case QUALIFY_WAIT:
+        // nothing counts until the spindle is turning
+        if( currentRpm > 0 )
+        {
+            this->qualifyState = QUALIFY_RUN;
+        }
+        restart = true;
+        break;
+
+    case QUALIFY_RUN:
+        if( currentRpm == 0 )
+        {
+            // stopped before the measurement finished
+            this->qualifyState = QUALIFY_WAIT;
+            restart = true;
+        }
+        else if( qualifyCount() > 0 )
+        {
+            if( encoder->getQualification() <= this->qualifyFloor )
+            {
+                // any weaker and the noise gets through
+                failQualify();
+                return;
+            }
+            // edges are being lost; try the next weaker filter
+            encoder->setQualification(encoder->getQualification() - 1);
+            restart = true;
+        }
+        else if( ++this->qualifyTime >= QUALIFY_TIME )
+        {
+            stopQualify(true);
+            setMessage(&CALIBRATION_DONE_MESSAGE);
+            this->diagnostics = false;
+        }
+        break;
+    }
+
+    if( restart )
+    {
+        this->qualifyTime = 0;
+        this->qualifyErrors = encoder->getErrorCount();
+        encoder->countGlitches(true);
+    }
+}
+
+void UserInterface :: readRPM( void )
+{
+    this->rpm = core->getRPM();
+}
+
 void UserInterface :: loop( void )
 {
-    // read the RPM up front so we can use it to make decisions
-    Uint16 currentRpm = core->getRPM();
+    // use the same RPM throughout so the decisions agree
+    Uint16 currentRpm = this->rpm;
 
-    // display an override message, if there is one
+    // warn about a noisy encoder, then display an override message, if there is one
+    checkEncoder();
+    checkCalibration();
+    checkQualify(currentRpm);
     overrideMessage();
 
-    // read keypresses from the control panel
-    keys = controlPanel->getKeys();
+    // take one key event from the control panel per pass; a repeat counts
+    // as another press, and a long press comes after the key's first press
+    KEY_EVENT event;
+    keys.all = 0;
+    longKeys.all = 0;
+    if( controlPanel->getKeyEvent(&event) ) {
+        if( event.type == KEY_LONG_PRESS ) {
+            longKeys = event.key;
+        }
+        else {
+            keys = event.key;
+        }
+    }
+
+    // a latched alarm takes over the display and keys
+    if( handleAlarm(currentRpm) )
+    {
+        keys.all = 0;
+        longKeys.all = 0;
+        this->editing = false;
+        this->diagnostics = false;
+        this->indexing = false;
+#ifdef USE_HANDWHEEL
+        this->jogView = false;
+        this->jogLatched = false;
+#endif // USE_HANDWHEEL
+#ifdef USE_CROSS_SLIDE
+        this->taperView = false;
+#endif // USE_CROSS_SLIDE
+    }
+
+    // numeric entry, diagnostics, indexing, taper and jogging own the keys
+    // while they are active
+    if( handleEdit() || handleDiagnostics() || handleIndexing() )
+    {
+        keys.all = 0;
+    }
+#ifdef USE_CROSS_SLIDE
+    else if( handleTaper() )
+    {
+        keys.all = 0;
+    }
+#endif // USE_CROSS_SLIDE
+#ifdef USE_HANDWHEEL
+    else if( handleJog() )
+    {
+        keys.all = 0;
+    }
+
+    // the handwheel only moves the carriage with the spindle stopped, unless
+    // jog mode is latched
+    core->setJogEnabled(currentRpm == 0 || this->jogLatched);
+#endif // USE_HANDWHEEL
 
     // respond to keypresses
     if( currentRpm == 0 )
@@ -145,17 +957,35 @@ void UserInterface :: loop( void )
             this->core->setPowerOn(!this->core->isPowerOn());
         }
 
+        // with the power off, SET opens the diagnostics view
+        if( keys.bit.SET && ! this->core->isPowerOn() ) {
+            this->diagnostics = true;
+            this->diagnosticPage = 0;
+        }
+
+        // and FEED/THREAD opens the indexing view
+        if( keys.bit.FEED_THREAD && ! this->core->isPowerOn() ) {
+            startIndexing();
+        }
+
+#ifdef USE_CROSS_SLIDE
+        // and IN/MM opens the taper view
+        if( keys.bit.IN_MM && ! this->core->isPowerOn() ) {
+            this->taperView = true;
+        }
+#endif // USE_CROSS_SLIDE
+
         // these should only work when the power is on
         if( this->core->isPowerOn() ) {
             if( keys.bit.IN_MM )
             {
                 this->metric = ! this->metric;
-                core->setFeed(loadFeedTable());
+                applyFeed(loadFeedTable());
             }
             if( keys.bit.FEED_THREAD )
             {
                 this->thread = ! this->thread;
-                core->setFeed(loadFeedTable());
+                applyFeed(loadFeedTable());
             }
             if( keys.bit.FWD_REV )
             {
@@ -164,7 +994,7 @@ void UserInterface :: loop( void )
             }
             if( keys.bit.SET )
             {
-                setMessage(&SETTINGS_MESSAGE_1);
+                startEdit();
             }
         }
     }
@@ -179,22 +1009,49 @@ void UserInterface :: loop( void )
             // these keys can be operated when the machine is running
             if( keys.bit.UP )
             {
-                core->setFeed(feedTable->next());
+                // leaving a custom feed goes back to the last table entry
+                if( this->customFeed != NULL ) {
+                    this->customFeed = NULL;
+                    applyFeed(feedTable->current());
+                }
+                else {
+                    applyFeed(feedTable->next());
+                }
             }
             if( keys.bit.DOWN )
             {
-                core->setFeed(feedTable->previous());
+                if( this->customFeed != NULL ) {
+                    this->customFeed = NULL;
+                    applyFeed(feedTable->current());
+                }
+                else {
+                    applyFeed(feedTable->previous());
+                }
             }
         }
 
 #ifdef IGNORE_ALL_KEYS_WHEN_RUNNING
     }
 #endif // IGNORE_ALL_KEYS_WHEN_RUNNING
+}
 
+void UserInterface :: refreshDisplay( void )
+{
     // update the control panel
     controlPanel->setLEDs(calculateLEDs());
-    controlPanel->setValue(feedTable->current()->display);
-    controlPanel->setRPM(currentRpm);
+    controlPanel->setValue(currentFeed()->display);
+    controlPanel->setRPM(this->rpm);
+
+    if( this->editing )
+    {
+        // show the value being entered, blinking the selected digit
+        feedTableFactory->formatValue(this->editDisplay, this->editValue, feedTableFactory->getCustomPoint(this->metric, this->thread));
+        if( this->blinkTime >= EDIT_BLINK_TIME / 2 )
+        {
+            this->editDisplay[this->editDigit] &= POINT;
+        }
+        controlPanel->setValue(this->editDisplay);
+    }
 
     if( ! core->isPowerOn() )
     {
@@ -29,11 +29,14 @@
 
 #include "ControlPanel.h"
 #include "Core.h"
+#include "Encoder.h"
 #include "Tables.h"
+#include "Settings.h"
+#include "Debug.h"
 
 typedef struct MESSAGE
 {
-    Uint16 message[8];
+    const char *text;
     Uint16 displayTime;
     const MESSAGE *next;
 } MESSAGE;
@@ -43,7 +46,10 @@ class UserInterface
 private:
     ControlPanel *controlPanel;
     Core *core;
+    Encoder *encoder;
     FeedTableFactory *feedTableFactory;
+    Settings *settings;
+    Debug *debug;
 
     bool metric;
     bool thread;
@@ -51,20 +57,119 @@ private:
 
     FeedTable *feedTable;
 
+    // feed typed in by the operator, or NULL when using the table
+    const FEED_THREAD *customFeed;
+
+    // numeric entry state
+    bool editing;
+    Uint16 editDigit;
+    Uint16 editValue;
+    Uint16 blinkTime;
+    Uint16 customValues[2][2];
+    Uint16 editDisplay[4];
+
+    // diagnostics view state
+    bool diagnostics;
+    Uint16 diagnosticPage;
+    Uint16 diagnosticDisplay[8];
+
+    // true while the encoder is measuring its resolution
+    bool calibrating;
+
+    // input qualification calibration state
+    Uint16 qualifyState;
+    Uint16 qualifyTime;
+    Uint32 qualifyErrors;
+    Uint16 qualifyPrevious;
+    Uint16 qualifyFloor;
+    Uint16 qualifyCeiling;
+
+    // indexing view state: spindle angle, or position in divisions
+    bool indexing;
+    bool indexDivide;
+    Uint16 indexDivisions;
+    Uint32 indexPrevious;
+    Uint32 indexCounts;
+    Uint16 indexDisplay[8];
+
+#ifdef USE_HANDWHEEL
+    // jog view state
+    bool jogView;
+    bool jogLatched;
+    Uint16 jogTime;
+    Uint16 jogScaleIndex;
+    Uint32 handwheelDetents;
+    Uint16 jogDisplay[8];
+#endif // USE_HANDWHEEL
+
+#ifdef USE_CROSS_SLIDE
+    // taper view state: cross-slide travel per unit of carriage travel, in
+    // thousandths, and whether the cross-slide moves the other way
+    bool taperView;
+    Uint16 taper;
+    bool taperReverse;
+    Uint16 taperDisplay[8];
+#endif // USE_CROSS_SLIDE
+
+    // encoder error count at the last warning
+    Uint32 warnedErrors;
+
     KEY_REG keys;
 
+    // keys held for a long press this pass; kept apart from keys so no view
+    // takes one for a second press
+    KEY_REG longKeys;
+
+    // spindle speed, read by readRPM()
+    Uint16 rpm;
+
     const MESSAGE *message;
     Uint16 messageTime;
+    Uint16 messageDisplay[8];
+
+    // true while a latched alarm is being displayed
+    bool alarm;
 
     const FEED_THREAD *loadFeedTable();
+    const FEED_THREAD *currentFeed();
+    void applyFeed(const FEED_THREAD *feed);
     LED_REG calculateLEDs();
     void setMessage(const MESSAGE *message);
+    void showText(const char *text);
     void overrideMessage( void );
+    bool handleAlarm( Uint16 currentRpm );
+    void startEdit( void );
+    bool handleEdit( void );
+    bool handleDiagnostics( void );
+#ifdef USE_HANDWHEEL
+    bool handleJog( void );
+#endif // USE_HANDWHEEL
+#ifdef USE_CROSS_SLIDE
+    bool handleTaper( void );
+#endif // USE_CROSS_SLIDE
+    int32 diagnosticValue( Uint16 page );
+    void startIndexing( void );
+    Uint32 spindleCount( void );
+    bool handleIndexing( void );
+    void checkEncoder( void );
+    void checkCalibration( void );
+    void startQualify( void );
+    void stopQualify( bool keep );
+    void failQualify( void );
+    Uint32 qualifyCount( void );
+    void checkQualify( Uint16 currentRpm );
 
 public:
-    UserInterface(ControlPanel *controlPanel, Core *core, FeedTableFactory *feedTableFactory);
+    UserInterface(ControlPanel *controlPanel, Core *core, Encoder *encoder, FeedTableFactory *feedTableFactory, Settings *settings, Debug *debug);
+
+    // read the spindle speed; run at RPM_CALC_RATE_HZ
+    void readRPM( void );
 
+    // read the keys and act on them; run at UI_REFRESH_RATE_HZ
     void loop( void );
+
+    // show the current state on the control panel
+    void refreshDisplay( void );
 };
 
 #endif // __USERINTERFACE_H
@@ -29,15 +29,35 @@
 #include "SanityCheck.h"
 #include "ControlPanel.h"
 #include "EEPROM.h"
+#include "Settings.h"
 #include "StepperDrive.h"
 #include "Encoder.h"
+#include "LeadscrewEncoder.h"
+#include "Handwheel.h"
 
 #include "Core.h"
 #include "UserInterface.h"
+#include "Scheduler.h"
 #include "Debug.h"
 
 
 __interrupt void cpu_timer0_isr(void);
+__interrupt void encoder_isr(void);
+__interrupt void encoder_wake_isr(void);
+__interrupt void spib_rx_isr(void);
+__interrupt void dma_ch6_isr(void);
+__interrupt void cpu_timer1_isr(void);
+
+// Motion code section symbols, created by the linker
+extern "C" {
+extern Uint16 MotionfuncsLoadStart;
+extern Uint16 MotionfuncsLoadSize;
+extern Uint16 MotionfuncsRunStart;
+}
+
+// CPU timer 0 periods for normal stepping and for the idle poll
+#define STEPPER_TIMER_PERIOD ((Uint32)CPU_CLOCK_MHZ * STEPPER_CYCLE_US)
+#define IDLE_TIMER_PERIOD ((Uint32)CPU_CLOCK_MHZ * IDLE_CYCLE_US)
 
 
 //
@@ -61,17 +81,87 @@ ControlPanel controlPanel(&spiBus);
 // EEPROM driver
 EEPROM eeprom(&spiBus);
 
+// Settings stored in EEPROM
+Settings settings(&eeprom);
+
 // Encoder driver
 Encoder encoder;
 
 // Stepper driver
-StepperDrive stepperDrive;
+StepperDrive stepperDrive(STEP_PIN, DIRECTION_PIN, ENABLE_PIN, ALARM_PIN);
+
+#ifdef USE_CROSS_SLIDE
+// Cross-slide stepper driver
+StepperDrive crossSlideDrive(CROSS_SLIDE_STEP_PIN, CROSS_SLIDE_DIRECTION_PIN, CROSS_SLIDE_ENABLE_PIN, CROSS_SLIDE_ALARM_PIN);
+#endif // USE_CROSS_SLIDE
+
+#ifdef USE_LEADSCREW_ENCODER
+// Leadscrew encoder driver
+LeadscrewEncoder leadscrewEncoder;
+#endif // USE_LEADSCREW_ENCODER
+
+#ifdef USE_HANDWHEEL
+// Handwheel driver
+Handwheel handwheel;
+#endif // USE_HANDWHEEL
 
 // Core engine
 Core core(&encoder, &stepperDrive);
 
 // User interface
-UserInterface userInterface(&controlPanel, &core, &feedTableFactory);
+UserInterface userInterface(&controlPanel, &core, &encoder, &feedTableFactory, &settings, &debug);
+
+// Main loop task scheduler
+Scheduler scheduler;
+
+
+//
+// MAIN LOOP TASKS
+//
+
+void rpmTask(void)
+{
+    userInterface.readRPM();
+}
+
+void keyScanTask(void)
+{
+    controlPanel.scanKeys();
+}
+
+void userInterfaceTask(void)
+{
+    // mark beginning of the user interface work for debugging
+    debug.begin2();
+
+    userInterface.loop();
+
+    // mark end of the user interface work for debugging
+    debug.end2();
+}
+
+void displayTask(void)
+{
+    userInterface.refreshDisplay();
+}
+
+void settingsTask(void)
+{
+    // write out anything the user interface changed
+    settings.save();
+}
+
+void telemetryTask(void)
+{
+    // make the main loop counters visible on the diagnostics pages
+    debug.recordTaskCounts(scheduler.getTotalOverruns(), scheduler.getTotalSkipped());
+
+#ifdef MEASURE_STEP_JITTER
+    // file step timing under the current speed and feed
+    debug.selectJitterBucket(core.getRPM(), core.getStepsPerRev());
+#endif // MEASURE_STEP_JITTER
+}
+
 
 void main(void)
 {
@@ -81,6 +171,9 @@ void main(void)
     // symbols are created by the linker. Refer to the linker files.
     memcpy(&RamfuncsRunStart, &RamfuncsLoadStart, (size_t)&RamfuncsLoadSize);
 
+    // Copy the stepper interrupt and the divide helpers it calls to zero-wait RAM
+    memcpy(&MotionfuncsRunStart, &MotionfuncsLoadStart, (size_t)&MotionfuncsLoadSize);
+
     // Initialize the flash instruction fetch pipeline
     // This configures the MCU to pre-fetch instructions from flash.
     InitFlash();
@@ -107,6 +200,12 @@ void main(void)
     // Set up the CPU0 timer ISR
     EALLOW;
     PieVectTable.TIMER0_INT = &cpu_timer0_isr;
+    PieVectTable.ENCODER_PIE_VECTOR = &encoder_isr;
+    PieVectTable.XINT1_INT = &encoder_wake_isr;
+    PieVectTable.XINT2_INT = &encoder_wake_isr;
+    PieVectTable.SPIB_RX_INT = &spib_rx_isr;
+    PieVectTable.DMA_CH6_INT = &dma_ch6_isr;
+    PieVectTable.TIMER1_INT = &cpu_timer1_isr;
     EDIS;
 
     // initialize the CPU timer
@@ -118,11 +217,32 @@ void main(void)
 
     // Initialize peripherals and pins
     debug.initHardware();
+    scheduler.initHardware();
     spiBus.initHardware();
     controlPanel.initHardware();
     eeprom.initHardware();
     stepperDrive.initHardware();
+#ifdef USE_CROSS_SLIDE
+    crossSlideDrive.initHardware();
+#endif // USE_CROSS_SLIDE
     encoder.initHardware();
+#ifdef USE_LEADSCREW_ENCODER
+    leadscrewEncoder.initHardware();
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_HANDWHEEL
+    handwheel.initHardware();
+#endif // USE_HANDWHEEL
+
+    // Attach optional components to the core
+#ifdef USE_CROSS_SLIDE
+    core.setCrossSlideDrive(&crossSlideDrive);
+#endif // USE_CROSS_SLIDE
+#ifdef USE_LEADSCREW_ENCODER
+    core.setLeadscrewEncoder(&leadscrewEncoder);
+#endif // USE_LEADSCREW_ENCODER
+#ifdef USE_HANDWHEEL
+    core.setHandwheel(&handwheel);
+#endif // USE_HANDWHEEL
 
     // Enable CPU INT1 which is connected to CPU-Timer 0
     IER |= M_INT1;
@@ -130,28 +250,58 @@ void main(void)
     // Enable TINT0 in the PIE: Group 1 interrupt 7
     PieCtrlRegs.PIEIER1.bit.INTx7 = 1;
 
+    // Enable the encoder edge wake from the idle poll: Group 1 interrupts 4 and 5
+    PieCtrlRegs.PIEIER1.bit.INTx4 = 1;
+    PieCtrlRegs.PIEIER1.bit.INTx5 = 1;
+
+    // Enable the spindle eQEP interrupt for encoder error checks: Group 5
+    IER |= M_INT5;
+    ENCODER_PIE_ENABLE = 1;
+
+    // Enable the SPIB receive FIFO interrupt that runs the shared bus: Group 6 interrupt 3
+    IER |= M_INT6;
+    PieCtrlRegs.PIEIER6.bit.INTx3 = 1;
+
+    // Enable the SPIB receive DMA completion interrupt: Group 7 interrupt 6
+    IER |= M_INT7;
+    PieCtrlRegs.PIEIER7.bit.INTx6 = 1;
+
+    // Enable CPU INT13 which is connected to CPU-Timer 1, for SPI chip select timing
+    IER |= M_INT13;
+
     // Enable global Interrupts and higher priority real-time debug events
     EINT;
     ERTM;
 
-    // User interface loop
-    for(;;) {
-        // mark beginning of loop for debugging
-        debug.begin2();
-
-        // service the user interface
-        userInterface.loop();
+    // Apply saved settings; the EEPROM needs the SPI interrupt running
+    settings.load();
+    if( settings.getEncoderResolution() != 0 ) {
+        core.setEncoderResolution(settings.getEncoderResolution());
+    }
+    if( settings.hasInputQualification() ) {
+        encoder.setQualification(settings.getInputQualification());
+    }
 
-        // mark end of loop for debugging
-        debug.end2();
+    // Main loop tasks, in the order they run when due together
+    scheduler.addTask(&rpmTask, 1000000 / RPM_CALC_RATE_HZ);
+    scheduler.addTask(&keyScanTask, 1000000 / KEY_SCAN_RATE_HZ);
+    scheduler.addTask(&userInterfaceTask, 1000000 / UI_REFRESH_RATE_HZ);
+    scheduler.addTask(&displayTask, 1000000 / UI_REFRESH_RATE_HZ);
+    scheduler.addTask(&settingsTask, 1000000 / SETTINGS_SAVE_RATE_HZ);
+    scheduler.addTask(&telemetryTask, 1000000 / TELEMETRY_RATE_HZ);
 
-        // delay
-        DELAY_US(1000000 / UI_REFRESH_RATE_HZ);
+    // Main loop
+    scheduler.start();
+    for(;;) {
+        scheduler.runDue();
     }
 }
 
 
 // CPU Timer 0 ISR
+#ifdef MOTION_CODE_IN_RAM
+#pragma CODE_SECTION("motionfuncs")
+#endif // MOTION_CODE_IN_RAM
 __interrupt void
 cpu_timer0_isr(void)
 {
@@ -166,6 +316,33 @@ cpu_timer0_isr(void)
     // flag exit from ISR for timing
     debug.end1();
 
+    // measure the ISR time so the cost of each axis can be compared
+    debug.recordIsrTime();
+
+#ifdef MEASURE_STEP_JITTER
+    // and how late the leadscrew step edge was, if there was one
+    Uint32 stepEdgeTimer;
+    if( stepperDrive.getStepEdge(&stepEdgeTimer) ) {
+        debug.recordStepEdge(stepEdgeTimer);
+    }
+#endif // MEASURE_STEP_JITTER
+
+    // drop to a slow poll while nothing is moving, and back to full speed,
+    // reloading the counter immediately, as soon as anything changes.  With
+    // the power on, the first encoder edge forces the next tick at once.
+    if( core.isIdle() ) {
+        if( CpuTimer0Regs.PRD.all != IDLE_TIMER_PERIOD ) {
+            CpuTimer0Regs.PRD.all = IDLE_TIMER_PERIOD;
+            if( core.isPowerOn() ) {
+                encoder.armWake();
+            }
+        }
+    }
+    else if( CpuTimer0Regs.PRD.all != STEPPER_TIMER_PERIOD ) {
+        CpuTimer0Regs.PRD.all = STEPPER_TIMER_PERIOD;
+        CpuTimer0Regs.TCR.bit.TRB = 1;
+    }
+
     //
     // Acknowledge this interrupt to receive more interrupts from group 1
     //
@@ -173,3 +350,88 @@ cpu_timer0_isr(void)
 }
 
 
+// Spindle eQEP ISR
+__interrupt void
+encoder_isr(void)
+{
+    // count phase errors and check index pulses
+    encoder.ISR();
+
+    //
+    // Acknowledge this interrupt to receive more interrupts from group 5
+    //
+    PieCtrlRegs.PIEACK.all = PIEACK_GROUP5;
+}
+
+
+// Encoder edge ISR, for XINT1 and XINT2 while idle
+__interrupt void
+encoder_wake_isr(void)
+{
+    // latch the time of the edge, then run the stepper ISR at full speed from
+    // the next stepper cycle instead of waiting out the idle poll
+    encoder.wakeISR();
+    CpuTimer0Regs.PRD.all = STEPPER_TIMER_PERIOD;
+    CpuTimer0Regs.TCR.bit.TRB = 1;
+
+    //
+    // Acknowledge this interrupt to receive more interrupts from group 1
+    //
+    PieCtrlRegs.PIEACK.all = PIEACK_GROUP1;
+}
+
+
+// SPIB receive FIFO ISR
+__interrupt void
+spib_rx_isr(void)
+{
+    // let the stepper timer interrupt this one; the bus can take a while
+    Uint16 savedIER = IER;
+    IER = M_INT1;
+    PieCtrlRegs.PIEACK.all = PIEACK_GROUP6;
+    asm(" NOP");
+    EINT;
+
+    // move the next chunk of the current transaction
+    spiBus.ISR();
+
+    DINT;
+    IER = savedIER;
+}
+
+
+// SPIB receive DMA ISR
+__interrupt void
+dma_ch6_isr(void)
+{
+    // let the stepper timer interrupt this one, as for the SPI interrupt
+    Uint16 savedIER = IER;
+    IER = M_INT1;
+    PieCtrlRegs.PIEACK.all = PIEACK_GROUP7;
+    asm(" NOP");
+    EINT;
+
+    // a DMA step has finished on the wire
+    spiBus.dmaISR();
+
+    DINT;
+    IER = savedIER;
+}
+
+
+// CPU Timer 1 ISR
+__interrupt void
+cpu_timer1_isr(void)
+{
+    // let the stepper timer interrupt this one, as for the SPI interrupt;
+    // INT13 doesn't go through the PIE, so there is nothing to acknowledge
+    Uint16 savedIER = IER;
+    IER = M_INT1;
+    EINT;
+
+    // a pause between SPI steps is over
+    spiBus.timerISR();
+
+    DINT;
+    IER = savedIER;
+}